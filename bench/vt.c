@@ -0,0 +1,203 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <magma/logger/log.h>
+#include <magma/vt.h>
+
+/* Headless throughput benchmark for the VT parser.
+ *
+ * Builds a canned byte stream in memory and feeds it through
+ * magma_vt_parse() in MAGMA_VT_READ_SIZE chunks, the same way
+ * vt_read_input() hands them over, with no backend or renderer.
+ *
+ * usage: magma-bench-vt <ascii|ls-color|utf8|tui> [MiB] [iterations]
+ */
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 200
+
+typedef struct {
+	uint8_t *data;
+	size_t len, size;
+} bench_buf_t;
+
+static void bench_append(bench_buf_t *buf, const char *str, size_t len) {
+	if(buf->len + len > buf->size) {
+		len = buf->size - buf->len;
+	}
+
+	memcpy(&buf->data[buf->len], str, len);
+	buf->len += len;
+}
+
+static void bench_appendf(bench_buf_t *buf, const char *fmt, ...) {
+	char tmp[256];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(tmp, sizeof(tmp), fmt, args);
+	va_end(args);
+
+	bench_append(buf, tmp, len);
+}
+
+/*compiler output, cat of source files*/
+static void bench_gen_ascii(bench_buf_t *buf) {
+	static const char words[] = "the quick brown fox jumps over the lazy dog "
+		"int main(int argc, char **argv) { return 0; } "
+		"src/vt/parser.c:42:13: warning: unused variable 'x' ";
+	size_t pos = 0, col;
+
+	while(buf->len < buf->size) {
+		for(col = 0; col < 79; col++) {
+			bench_append(buf, &words[pos], 1);
+			pos = (pos + 1) % (sizeof(words) - 1);
+		}
+		bench_append(buf, "\r\n", 2);
+	}
+}
+
+/*ls --color output, short runs broken up by SGR*/
+static void bench_gen_ls_color(bench_buf_t *buf) {
+	static const char *entries[] = {
+		"\x1b[0m\x1b[01;34mbuild\x1b[0m",
+		"\x1b[01;32mconfigure\x1b[0m",
+		"README.md",
+		"\x1b[01;36mlib64\x1b[0m",
+		"meson.build",
+		"\x1b[38;5;208mnotes.tar.gz\x1b[0m",
+		"\x1b[01;34msrc\x1b[0m",
+		"\x1b[38;2;255;100;0mhot.log\x1b[0m",
+	};
+	size_t n = sizeof(entries) / sizeof(entries[0]);
+
+	for(size_t i = 0; buf->len < buf->size; i++) {
+		bench_append(buf, entries[i % n], strlen(entries[i % n]));
+		if(i % 6 == 5) {
+			bench_append(buf, "\r\n", 2);
+		} else {
+			bench_append(buf, "  ", 2);
+		}
+	}
+}
+
+/*multilingual logs*/
+static void bench_gen_utf8(bench_buf_t *buf) {
+	static const char *lines[] = {
+		"2024-01-01 12:00:00 Grüße aus Köln, naïve café résumé\r\n",
+		"2024-01-01 12:00:01 Привет, мир! Съешь же ещё этих мягких булок\r\n",
+		"2024-01-01 12:00:02 日本語のテキストと漢字の混在したログ出力\r\n",
+		"2024-01-01 12:00:03 emoji 😀🚀✨ build passed ✅ 𠀋𠂢\r\n",
+		"2024-01-01 12:00:04 Ελληνικά και العربية mixed with ASCII\r\n",
+	};
+	size_t n = sizeof(lines) / sizeof(lines[0]);
+
+	for(size_t i = 0; buf->len < buf->size; i++) {
+		bench_append(buf, lines[i % n], strlen(lines[i % n]));
+	}
+}
+
+/*full screen redraws like htop or vim, mostly cursor motion*/
+static void bench_gen_tui(bench_buf_t *buf) {
+	uint32_t seed = 1;
+
+	while(buf->len < buf->size) {
+		bench_appendf(buf, "\x1b[H\x1b[2J");
+		for(int row = 1; row <= BENCH_ROWS && buf->len < buf->size; row++) {
+			seed = seed * 1103515245 + 12345;
+			bench_appendf(buf, "\x1b[%d;1H\x1b[K\x1b[%dm%5u\x1b[0m \x1b[1;%dH\x1b[7m%3u%%\x1b[27m",
+					row, 31 + (seed >> 16) % 7, seed >> 16, 10 + (seed >> 8) % 60, (seed >> 4) % 100);
+			bench_appendf(buf, "\x1b[%dG\x1b[38;5;%umprocess\x1b[39m\x1b[%dC|",
+					80, (seed >> 12) % 256, (seed >> 20) % 10 + 1);
+		}
+		bench_appendf(buf, "\x1b[%d;%dH", 1 + seed % BENCH_ROWS, 1 + (seed >> 8) % BENCH_COLS);
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*gen)(bench_buf_t *buf);
+} streams[] = {
+	{ "ascii", bench_gen_ascii },
+	{ "ls-color", bench_gen_ls_color },
+	{ "utf8", bench_gen_utf8 },
+	{ "tui", bench_gen_tui },
+};
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	bench_buf_t buf = { 0 };
+	magma_vt_t *vt;
+	double start, best = 0, elapsed;
+	size_t mib = 32, chunk;
+	int iterations = 5, stream = -1;
+
+	magma_log_set_level(MAGMA_WARN);
+
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <ascii|ls-color|utf8|tui> [MiB] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	for(size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+		if(strcmp(argv[1], streams[i].name) == 0) {
+			stream = i;
+		}
+	}
+
+	if(stream < 0) {
+		fprintf(stderr, "unknown stream %s\n", argv[1]);
+		return 1;
+	}
+
+	if(argc > 2) mib = strtoul(argv[2], NULL, 10);
+	if(argc > 3) iterations = atoi(argv[3]);
+
+	buf.size = mib * 1024 * 1024;
+	buf.data = malloc(buf.size);
+	if(!buf.data) {
+		fprintf(stderr, "failed to allocate %zu MiB\n", mib);
+		return 1;
+	}
+	streams[stream].gen(&buf);
+
+	for(int i = 0; i < iterations; i++) {
+		vt = magma_vt_init(BENCH_ROWS, BENCH_COLS);
+		if(!vt) {
+			return 1;
+		}
+
+		start = bench_now();
+		for(size_t off = 0; off < buf.len; off += chunk) {
+			chunk = buf.len - off;
+			if(chunk > MAGMA_VT_READ_SIZE) {
+				chunk = MAGMA_VT_READ_SIZE;
+			}
+			magma_vt_parse(vt, &buf.data[off], chunk);
+		}
+		elapsed = bench_now() - start;
+
+		if(i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+
+		magma_vt_deinit(vt);
+	}
+
+	printf("%s: %zu bytes, best of %d: %.3f s, %.1f MB/s, %.2f ns/byte\n",
+			streams[stream].name, buf.len, iterations, best,
+			buf.len / best / 1e6, best * 1e9 / buf.len);
+
+	free(buf.data);
+	return 0;
+}
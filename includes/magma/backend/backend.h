@@ -67,6 +67,11 @@ void magma_backend_set_on_cursor(magma_backend_t *backend, void (*cursor_motion)
 /*call into backends*/
 struct xkb_keymap *magma_backend_get_xkbmap(magma_backend_t *backend, struct xkb_context *context);
 struct xkb_state *magma_backend_get_xkbstate(magma_backend_t *backend, struct xkb_keymap *keymap);
+/**
+ *	@brief present a frame
+ *	@param [in] backend the backend to draw to
+ *	@param [in] buffer the pixels, still owned by the caller after the call
+ */
 void magma_backend_put_buffer(magma_backend_t *backend, magma_buf_t *buffer);
 
 void magma_backend_get_vk_exts(magma_backend_t *backend, char ***extensions, uint32_t *size);
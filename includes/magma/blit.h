@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <magma/backend/backend.h>
+#include <magma/glyph_cache.h>
+
+/* Software blitting of cached glyphs into an XRGB8888 buffer.
+ * Each glyph format has its own row kernel, vectorized with
+ * AVX2 or SSE2 when the build targets them.
+ */
+
+/**
+ *	@brief draw a glyph's coverage in fg over what is in the buffer
+ *
+ *	Pixels a mono glyph doesn't cover are left alone, gray
+ *	coverage blends fg in linear light with the pixel underneath,
+ *	which is the cell's background. Whatever falls outside of the
+ *	buffer is clipped.
+ *
+ *	@param [in] buf the buffer drawn into
+ *	@param [in] glyph the glyph's size and format
+ *	@param [in] bitmap the glyph's pixels
+ *	@param [in] x the pen position, the glyph's left bearing is added
+ *	@param [in] y the baseline, the glyph's top bearing is subtracted
+ *	@param [in] fg the color of full coverage
+ */
+void magma_blit_glyph(magma_buf_t *buf, const magma_glyph_t *glyph, const uint8_t *bitmap,
+		int x, int y, uint32_t fg);
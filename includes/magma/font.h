@@ -6,6 +6,10 @@
 
 #include <fontconfig/fontconfig.h>
 
+/*style bits, a style is also the index of its face*/
+#define MAGMA_FONT_BOLD (1 << 0)
+#define MAGMA_FONT_ITALIC (1 << 1)
+#define MAGMA_FONT_STYLES 4
 
 typedef struct magma_font {
 	uint32_t height;
@@ -19,8 +23,25 @@ typedef struct magma_font {
 
 	FcConfig *font_config;
 	FT_Library ft_lib;
-	FT_Face face;
+
+	/* a face per style, the cell metrics come from the regular
+	 * one. A style the font doesn't have shares the closest face
+	 * and has the bits it lacks set in synthetic, those are made
+	 * up when its glyphs are rendered
+	 */
+	FT_Face faces[MAGMA_FONT_STYLES];
+	uint8_t synthetic[MAGMA_FONT_STYLES];
 } magma_font_t;
 
 magma_font_t *magma_font_init(const char *fconfig_str);
 void magma_font_deinit(magma_font_t *font);
+
+/**
+ *	@brief set the size of every face and update the cell metrics
+ *
+ *	@param [in] font the font
+ *	@param [in] size the pixel size of an em
+ *	@retval 0 on success
+ *	@retval -1 the regular face couldn't be set to the size
+ */
+int magma_font_set_size(magma_font_t *font, uint32_t size);
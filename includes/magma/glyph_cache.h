@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <magma/font.h>
+#include <magma/vt.h>
+
+/* Rasterized glyphs of one font at its current size. Each
+ * distinct character and style is rendered by FreeType once,
+ * after that drawing it is a lookup. The style picks the face,
+ * so a synthetic bold or italic is made up once too. Printable
+ * ASCII is found in a direct table, everything else through a hash.
+ */
+
+
+/*once the bitmaps take up this much the whole cache is flushed*/
+#define MAGMA_GLYPH_CACHE_MAX (4 * 1024 * 1024)
+
+enum magma_glyph_format {
+	/*1 bit per pixel, most significant bit first*/
+	MAGMA_GLYPH_FORMAT_MONO,
+	/*1 byte of coverage per pixel*/
+	MAGMA_GLYPH_FORMAT_GRAY,
+};
+
+/* a bitmap ready to blit, left and top are the bearings from
+ * the pen position on the baseline like FreeType's
+ */
+typedef struct {
+	int16_t left, top;
+	uint16_t width, rows;
+	uint16_t pitch;
+	uint8_t format;
+	bool cached;
+	/*of the bitmap in magma_glyph_cache_t.arena*/
+	uint32_t offset;
+} magma_glyph_t;
+
+typedef struct {
+	/*the cell's character, 0 when the slot is empty*/
+	utf32_t unicode;
+	/*for a cluster, the table generation its id is from*/
+	uint32_t generation;
+	/*MAGMA_FONT_* bits, the face it's from*/
+	uint8_t style;
+	magma_glyph_t glyph;
+} magma_glyph_entry_t;
+
+typedef struct magma_glyph_cache {
+	magma_font_t *font;
+	/*FT_RENDER_MODE_NORMAL or _MONO, clear the cache after changing it*/
+	int render_mode;
+
+	/*bitmaps of all glyphs back to back*/
+	uint8_t *arena;
+	size_t arena_used, arena_size;
+
+	/*open addressed, at most half full*/
+	magma_glyph_entry_t *entries;
+	uint32_t mask, count;
+
+	magma_glyph_t ascii[MAGMA_FONT_STYLES][128];
+} magma_glyph_cache_t;
+
+/**
+ *	@brief create an empty cache
+ *
+ *	@param [in] font the font glyphs are rendered with
+ *	@retval NULL allocation failed
+ */
+magma_glyph_cache_t *magma_glyph_cache_init(magma_font_t *font);
+void magma_glyph_cache_deinit(magma_glyph_cache_t *cache);
+
+/**
+ *	@brief drop every glyph, needed after the font size changed
+ *
+ *	@param [in] cache the cache
+ */
+void magma_glyph_cache_clear(magma_glyph_cache_t *cache);
+
+/**
+ *	@brief look up a glyph outside the ASCII table, rendering it on a miss
+ *
+ *	@see magma_glyph_cache_get
+ */
+const magma_glyph_t *magma_glyph_cache_find(magma_glyph_cache_t *cache, const magma_vt_t *vt,
+		utf32_t unicode, unsigned style);
+
+/**
+ *	@brief get the bitmap of a cell's character
+ *
+ *	A cluster is keyed on its id and the generation of the
+ *	table, so an id that was collected and reused misses.
+ *
+ *	@param [in] cache the cache
+ *	@param [in] vt the vt clusters are looked up in
+ *	@param [in] unicode a code point or cluster, not 0
+ *	@param [in] style MAGMA_FONT_* bits
+ *	@retval NULL the glyph couldn't be rendered
+ */
+static inline const magma_glyph_t *magma_glyph_cache_get(magma_glyph_cache_t *cache, const magma_vt_t *vt,
+		utf32_t unicode, unsigned style) {
+	if(unicode < 128 && cache->ascii[style][unicode].cached) {
+		return &cache->ascii[style][unicode];
+	}
+
+	return magma_glyph_cache_find(cache, vt, unicode, style);
+}
+
+static inline const uint8_t *magma_glyph_bitmap(const magma_glyph_cache_t *cache, const magma_glyph_t *glyph) {
+	return &cache->arena[glyph->offset];
+}
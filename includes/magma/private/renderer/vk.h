@@ -9,6 +9,56 @@ struct queue_indicies {
 	uint32_t compute, graphics, transfer;
 };
 
+/*most pages the glyph atlas grows to before it evicts*/
+#define MAGMA_VK_ATLAS_PAGES 4
+/*staging memory for glyphs waiting to be copied to their page*/
+#define MAGMA_VK_ATLAS_STAGING (256 * 1024)
+#define MAGMA_VK_ATLAS_REGIONS 512
+
+/*the top edge of the packed area from x to x + width*/
+typedef struct {
+	uint16_t x, y, width;
+} magma_vk_skyline_t;
+
+typedef struct {
+	VkImage image;
+	VkDeviceMemory memory;
+	VkImageView view;
+	VkImageLayout layout;
+	VkDescriptorSet set;
+
+	magma_vk_skyline_t *skyline;
+	uint32_t n_skyline;
+
+	/*frame a glyph on the page was last looked up in*/
+	uint64_t last_used;
+} magma_vk_atlas_page_t;
+
+typedef struct {
+	magma_vk_atlas_page_t pages[MAGMA_VK_ATLAS_PAGES];
+	uint32_t n_pages;
+
+	/*open addressed on the key, at most half full*/
+	magma_vk_atlas_glyph_t *entries;
+	uint32_t mask, count;
+
+	VkSampler sampler;
+	VkDescriptorSetLayout set_layout;
+	VkDescriptorPool pool;
+
+	/*new glyphs wait here until magma_vk_atlas_flush*/
+	VkBuffer staging;
+	VkDeviceMemory staging_mem;
+	uint8_t *staging_map;
+	size_t staging_used;
+	VkBufferImageCopy regions[MAGMA_VK_ATLAS_REGIONS];
+	uint16_t region_page[MAGMA_VK_ATLAS_REGIONS];
+	uint32_t n_regions;
+
+	VkCommandBuffer upload;
+	uint64_t frame;
+} magma_vk_atlas_t;
+
 
 struct magma_vk_renderer {
 	VkInstance instance;
@@ -28,6 +78,8 @@ struct magma_vk_renderer {
 	VkCommandBuffer draw_buffer;
 	VkCommandBuffer transfer;
 
+	magma_vk_atlas_t atlas;
+
 	VkPipelineLayout pipeline_layout;
 	VkPipeline graphics_pipeline;
 
@@ -53,3 +105,5 @@ VkResult magma_vk_create_instance(magma_backend_t *backend, VkAllocationCallback
 VkResult magma_vk_create_debug_messenger(VkInstance instance, VkAllocationCallbacks *callbacks, VkDebugUtilsMessengerEXT *messenger);
 VkResult magma_vk_get_physical_device(magma_vk_renderer_t *renderer);
 VkResult magma_vk_create_device(magma_vk_renderer_t *vk);
+VkResult magma_vk_create_atlas(magma_vk_renderer_t *vk);
+void magma_vk_destroy_atlas(magma_vk_renderer_t *vk);
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <magma/vt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*keep the producer and consumer indices on separate cache lines*/
+#define MAGMA_CACHE_LINE 64
+
+typedef struct magma_ring {
+	uint8_t *buf;
+	size_t size;
+
+	_Alignas(MAGMA_CACHE_LINE) _Atomic size_t head;
+	_Alignas(MAGMA_CACHE_LINE) _Atomic size_t tail;
+} magma_ring_t;
+
+/* Thread moving bytes from the pty master into a ring
+ * so the kernel buffer is kept empty while we draw
+ */
+struct magma_vt_reader {
+	pthread_t thread;
+	magma_ring_t ring;
+	int master;
+
+	/* wake is written by the main thread to stop the reader
+	 * or tell it space was freed, notify by the reader when
+	 * there is data waiting in the ring
+	 */
+	int wake[2];
+	int notify[2];
+
+	_Atomic bool running;
+	_Atomic bool hangup;
+	_Atomic bool full;
+	_Atomic bool notified;
+};
+
+/*styles the table starts with, it doubles up to UINT16_MAX + 1*/
+#define MAGMA_STYLES_INITIAL 256
+
+int magma_styles_init(magma_styles_t *styles);
+void magma_styles_deinit(magma_styles_t *styles);
+
+/**
+ *	@brief get the index of a style, adding it when new
+ *
+ *	When the table is full and can't grow, the styles no
+ *	cell on the grid or in the recent scrollback uses are
+ *	collected first.
+ *
+ *	@param [in] vt the vt owning the table
+ *	@param [in] style the style to look up
+ *	@return the index, 0 (the default style) if it couldn't be added
+ */
+uint16_t magma_styles_intern(magma_vt_t *vt, const magma_style_t *style);
+
+/*ids and code points the cluster table starts with, both double as needed*/
+#define MAGMA_CLUSTERS_INITIAL 256
+#define MAGMA_CLUSTERS_DATA_INITIAL 1024
+/*longer clusters drop the code points past this*/
+#define MAGMA_CLUSTER_MAX 32
+
+int magma_clusters_init(magma_clusters_t *clusters);
+void magma_clusters_deinit(magma_clusters_t *clusters);
+
+/**
+ *	@brief get the id of a cluster, adding it when new
+ *
+ *	When the table is full the clusters no cell on the
+ *	grid or in the recent scrollback uses are collected first.
+ *
+ *	@param [in] vt the vt owning the table
+ *	@param [in] cps the code points, at least two
+ *	@param [in] len number of code points, at most MAGMA_CLUSTER_MAX
+ *	@return the id with MAGMA_GLYPH_CLUSTER set, 0 if it couldn't be added
+ */
+utf32_t magma_clusters_intern(magma_vt_t *vt, const utf32_t *cps, int len);
+
+/**
+ *	@brief get the cluster of a cell with one more code point
+ *
+ *	@param [in] vt the vt owning the table
+ *	@param [in] unicode what the cell holds, a code point or a cluster
+ *	@param [in] cp the code point to add
+ *	@return the new cluster, unicode when it is full or couldn't be added
+ */
+utf32_t magma_clusters_append(magma_vt_t *vt, utf32_t unicode, utf32_t cp);
+
+/*rows kept as cells before they are packed*/
+#define MAGMA_SB_RECENT 256
+/*minimum size of a block of packed rows*/
+#define MAGMA_SB_BLOCK_SIZE (64 * 1024)
+
+/* Packed rows, appended one after another. A row is
+ * its byte size, cell count shifted left by one with the
+ * wrapped flag in bit 0 and attribute runs as LEB128
+ * varints followed by its code points as UTF8. A cluster
+ * is a 0xff byte, its code point count and the code points.
+ * Wide characters get their flags back from their width.
+ */
+typedef struct magma_sb_block {
+	struct magma_sb_block *prev, *next;
+	size_t size, used;
+	size_t n_rows;
+	uint8_t data[];
+} magma_sb_block_t;
+
+/*a wrapped row is never trimmed so len is the width it had*/
+typedef struct {
+	int len;
+	bool wrapped;
+	glyph_t *cells;
+} magma_sb_row_t;
+
+/*a line of history as shown at the current width*/
+typedef struct {
+	/*first stored row of the wrapped line it is part of*/
+	uint64_t seq;
+	/*its cells in that line, short of cols before a wide character*/
+	uint32_t offset, len;
+} magma_sb_line_t;
+
+/* Lines that scrolled off the top of the screen. The newest
+ * MAGMA_SB_RECENT are kept as cells in a ring, older ones are
+ * packed into a list of blocks, oldest first. Whole blocks are
+ * dropped from the front to stay under budget bytes
+ */
+typedef struct magma_scrollback {
+	size_t budget, used;
+
+	/*styles and clusters of the cells pushed, packed rows store them resolved*/
+	magma_styles_t *styles;
+	magma_clusters_t *clusters;
+
+	magma_sb_row_t recent[MAGMA_SB_RECENT];
+	size_t recent_head, n_recent;
+
+	magma_sb_block_t *oldest, *newest;
+	size_t n_packed;
+
+	/* every row pushed gets the next sequence number, the
+	 * oldest row kept is pushed - n_packed - n_recent
+	 */
+	uint64_t pushed;
+
+	/* rows from boundary on were pushed at cols and are shown
+	 * as they are. Older ones are rewrapped into lines only
+	 * as far back as someone looked, walk is the oldest row
+	 * done so far
+	 */
+	int cols;
+	uint64_t boundary, walk;
+	magma_sb_line_t *lines;
+	size_t n_lines, lines_size;
+
+	/*row offsets and cell counts of the block last looked at*/
+	const magma_sb_block_t *index_block;
+	uint32_t (*index)[2];
+	size_t index_rows, index_size;
+
+	/*a row is encoded here before it is copied into a block*/
+	uint8_t *scratch;
+	size_t scratch_size;
+} magma_scrollback_t;
+
+/**
+ *	@brief allocate an empty scrollback
+ *
+ *	@param [in] budget bytes it may use, 0 keeps nothing
+ *	@param [in] cols width of the screen
+ *	@param [in] styles table the pushed cells' styles are in
+ *	@param [in] clusters table the pushed cells' clusters are in
+ *	@retval NULL allocation failed
+ */
+magma_scrollback_t *magma_scrollback_init(size_t budget, int cols, magma_styles_t *styles,
+		magma_clusters_t *clusters);
+void magma_scrollback_deinit(magma_scrollback_t *sb);
+
+/**
+ *	@brief add a row that scrolled off the screen
+ *
+ *	@param [in] sb the scrollback
+ *	@param [in] cells the row, copied
+ *	@param [in] cols number of cells in the row
+ *	@param [in] wrapped the row continues on the next one
+ *	@retval 0 success
+ *	@retval -1 allocation failed, the row is lost
+ */
+int magma_scrollback_push(magma_scrollback_t *sb, const glyph_t *cells, int cols, bool wrapped);
+
+/**
+ *	@brief take back the newest rows if they wrap onto the screen
+ *
+ *	Only rows still kept as cells are given back, the caller
+ *	owns rows and the cells in it
+ *
+ *	@param [in] sb the scrollback
+ *	@param [out] rows set to the rows, oldest first
+ *	@retval the number of rows, 0 when the newest row isn't wrapped
+ *	@retval -1 allocation failed
+ */
+int magma_scrollback_unwrap(magma_scrollback_t *sb, magma_sb_row_t **rows);
+
+/**
+ *	@brief change the width lines are shown at
+ *
+ *	Nothing is rewrapped here, rows already stored are
+ *	rewrapped as they are looked at
+ */
+void magma_scrollback_set_cols(magma_scrollback_t *sb, int cols);
+
+/**
+ *	@brief copy a line out of the scrollback
+ *
+ *	Styles of packed rows are interned again, so this can
+ *	add to the style table of vt
+ *
+ *	@param [in] vt the vt owning the scrollback
+ *	@param [in] index 0 for the newest line
+ *	@param [out] out filled with the line, padded with blank cells
+ *	@param [in] cols size of out, the width set on the scrollback
+ *	@retval >=0 number of cells before the padding
+ *	@retval -1 index is past the oldest line
+ */
+int magma_scrollback_get(magma_vt_t *vt, size_t index, glyph_t *out, int cols);
+
+/**
+ *	@brief count the lines at the current width
+ *
+ *	Older rows are only rewrapped until want lines are known
+ *
+ *	@param [in] sb the scrollback
+ *	@param [in] want how many lines the caller is interested in
+ *	@return the number of lines, at least want if there are that many
+ */
+size_t magma_scrollback_lines(magma_scrollback_t *sb, size_t want);
+
+/*drop the oldest rows until used fits in budget*/
+void magma_scrollback_set_budget(magma_scrollback_t *sb, size_t budget);
+
+/* Actions the parser hands back to the vt. Params and
+ * intermediates of the sequence are read from vt->parser
+ */
+void magma_vt_print(magma_vt_t *vt, utf32_t unicode);
+void magma_vt_print_ascii(magma_vt_t *vt, const uint8_t *buf, size_t len);
+void magma_vt_execute(magma_vt_t *vt, uint8_t byte);
+void magma_vt_esc_dispatch(magma_vt_t *vt, uint8_t final);
+void magma_vt_csi_dispatch(magma_vt_t *vt, uint8_t final);
+void magma_vt_osc_dispatch(magma_vt_t *vt);
+
+/**
+ *	@brief allocate a blank rows x cols grid
+ *
+ *	@retval NULL allocation failed
+ */
+magma_vt_grid_t *magma_vt_grid_alloc(int rows, int cols);
+void magma_vt_grid_free(magma_vt_grid_t *grid);
+
+/*point every row at the shared blank row*/
+void magma_vt_grid_clear(magma_vt_grid_t *grid, int rows);
+
+/*zeroed cells for a row that shares the blank row*/
+glyph_t *magma_vt_grid_take(magma_vt_grid_t *grid);
+
+/**
+ *	@brief get row y of the screen shown to write to
+ *
+ *	A row sharing the blank row gets cells of its own first,
+ *	every write to the grid has to go through this
+ */
+static inline line_t magma_vt_line_write(magma_vt_t *vt, int y) {
+	magma_vt_grid_t *grid = vt->grid;
+	int index = grid->head + y;
+
+	if(index >= vt->rows) {
+		index -= vt->rows;
+	}
+
+	if(grid->lines[index] == grid->blank) {
+		grid->lines[index] = magma_vt_grid_take(grid);
+	}
+
+	return grid->lines[index];
+}
+
+/*cells before x1 of row y may not be blank any more*/
+static inline void magma_vt_use(magma_vt_t *vt, int y, int x1) {
+	magma_vt_row_t *row = magma_vt_row(vt, y);
+
+	if(row->used < x1) {
+		row->used = x1;
+	}
+}
+
+/**
+ *	@brief show vt->other instead of vt->grid
+ *
+ *	Only the pointers are swapped, nothing is copied. The
+ *	renderer is told to redraw everything once
+ */
+void magma_vt_screen_swap(magma_vt_t *vt);
+
+/**
+ *	@brief scroll rows top to bottom by count
+ *
+ *	Only row pointers are moved, the rows scrolled in are
+ *	filled with blank and the move is recorded for the
+ *	renderer. Scrolling the whole screen up moves the head
+ *	of the ring instead.
+ *
+ *	@param [in] vt the vt
+ *	@param [in] top first row of the region
+ *	@param [in] bottom last row of the region, inclusive
+ *	@param [in] count rows to scroll, up when positive
+ *	@param [in] blank cell the new rows are filled with
+ */
+void magma_vt_grid_scroll(magma_vt_t *vt, int top, int bottom, int count, glyph_t blank);
+
+/*fill cells x0 up to x1 (exclusive) of screen row y with blank*/
+void magma_vt_grid_erase(magma_vt_t *vt, int y, int x0, int x1, glyph_t blank);
+
+/*ICH, shift the cells of row y from x on right by n, blank fills the gap*/
+void magma_vt_grid_insert(magma_vt_t *vt, int y, int x, int n, glyph_t blank);
+
+/*DCH, drop n cells of row y at x, the rest shifts left and blank fills in*/
+void magma_vt_grid_delete(magma_vt_t *vt, int y, int x, int n, glyph_t blank);
+
+/*set n cells of row y from x to cell, clipped to the row*/
+void magma_vt_grid_repeat(magma_vt_t *vt, int y, int x, int n, glyph_t cell);
+
+/**
+ *	@brief find the end of a run of printable ASCII
+ *
+ *	Uses AVX2 or SSE2 when the compiler targets them
+ *
+ *	@param [in] buf bytes to scan
+ *	@param [in] len number of bytes in buf
+ *	@return length of the run of 0x20-0x7e bytes at the start of buf
+ */
+size_t magma_vt_scan_printable(const uint8_t *buf, size_t len);
+
+/**
+ *	@brief find the end of a run of text
+ *
+ *	Like magma_vt_scan_printable but bytes above 0x7f
+ *	don't end the run
+ *
+ *	@param [in] buf bytes to scan
+ *	@param [in] len number of bytes in buf
+ *	@return number of bytes before the first C0 control or DEL
+ */
+size_t magma_vt_scan_text(const uint8_t *buf, size_t len);
+
+void magma_utf8_init(magma_utf8_t *utf8);
+
+/**
+ *	@brief drop a character left incomplete
+ *
+ *	@retval true a character was in progress and should
+ *	be replaced with U+FFFD
+ *	@retval false nothing was pending
+ */
+bool magma_utf8_flush(magma_utf8_t *utf8);
+
+/**
+ *	@brief decode UTF8 into UTF32 
+ *
+ *	Invalid sequences are replaced with U+FFFD, a character
+ *	cut off at the end of buf is kept in utf8 and finished
+ *	by the next call. Stops early when out is full.
+ *
+ *	@param [in/out] utf8 decoder state
+ *	@param [in] buf UTF8 bytes
+ *	@param [in] len number of bytes in buf
+ *	@param [out] out decoded code points
+ *	@param [in] out_len size of out, must be at least 2
+ *	@param [out] n_out number of code points written to out
+ *	@return number of bytes consumed from buf
+ */
+size_t magma_utf8_decode(magma_utf8_t *utf8, const uint8_t *buf, size_t len,
+		utf32_t *out, size_t out_len, size_t *n_out);
+
+/**
+ *	@brief allocate a ring
+ *
+ *	@param [in] ring the ring to set up
+ *	@param [in] size size in bytes, must be a power of two
+ *	@retval 0 success
+ *	@retval -1 bad size or allocation failed
+ */
+int magma_ring_init(magma_ring_t *ring, size_t size);
+void magma_ring_deinit(magma_ring_t *ring);
+
+/*producer side, space is contiguous and may be less than what is free*/
+size_t magma_ring_write_ptr(magma_ring_t *ring, uint8_t **ptr);
+void magma_ring_commit(magma_ring_t *ring, size_t len);
+
+/*consumer side, data is contiguous and may be less than what is queued*/
+size_t magma_ring_read_ptr(magma_ring_t *ring, const uint8_t **ptr);
+void magma_ring_release(magma_ring_t *ring, size_t len);
+
+size_t magma_ring_used(magma_ring_t *ring);
+
+/**
+ *	@brief consume what the reader thread has queued
+ *
+ *	@retval >=0 number of bytes parsed
+ *	@retval -1 the ring is empty and the child hung up
+ */
+ssize_t magma_vt_reader_consume(magma_vt_t *vt);
+
+/**
+ *	@brief build the parser transition table
+ *
+ *	Must be called before the first call to
+ *	magma_vt_parser_feed, calling it again is a no-op
+ */
+void magma_vt_parser_init(void);
+
+/**
+ *	@brief run len bytes through the parser state machine
+ *
+ *	@param [in] vt the vt owning the parser state
+ *	@param [in] buf bytes to feed
+ *	@param [in] len number of bytes in buf
+ */
+void magma_vt_parser_feed(magma_vt_t *vt, const uint8_t *buf, size_t len);
+
+/**
+ *	@brief get a CSI parameter with a default
+ *
+ *	@param [in] parser the parser holding the sequence
+ *	@param [in] index index of the parameter
+ *	@param [in] def value returned when the parameter is missing or 0
+ */
+static inline uint16_t magma_vt_param(const magma_vt_parser_t *parser, int index, uint16_t def) {
+	if(index >= parser->n_params || parser->params[index] == 0) {
+		return def;
+	}
+
+	return parser->params[index];
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <magma/backend/backend.h>
+#include <magma/glyph_cache.h>
 
 typedef struct magma_vk_renderer magma_vk_renderer_t;
 
@@ -8,3 +11,54 @@ typedef struct magma_vk_renderer magma_vk_renderer_t;
 magma_buf_t *magma_vk_draw(magma_vk_renderer_t *vk);
 void magma_vk_renderer_deinit(magma_vk_renderer_t *renderer);
 magma_vk_renderer_t *magma_vk_renderer_init(magma_backend_t *backend);
+
+/*side of the square glyph atlas pages in pixels*/
+#define MAGMA_VK_ATLAS_SIZE 1024
+
+/*where a glyph's coverage is in the atlas, one byte per pixel*/
+typedef struct magma_vk_atlas_glyph {
+	/*0 when the slot is empty*/
+	uint64_t key;
+	uint16_t page;
+	uint16_t x, y, width, height;
+} magma_vk_atlas_glyph_t;
+
+/**
+ *	@brief find a glyph in the atlas and mark it as used this frame
+ *
+ *	The returned glyph is valid until the next insert.
+ *
+ *	@param [in] vk the renderer
+ *	@param [in] key what the caller identifies the bitmap with, not 0
+ *	@retval NULL the glyph isn't in the atlas
+ */
+const magma_vk_atlas_glyph_t *magma_vk_atlas_lookup(magma_vk_renderer_t *vk, uint64_t key);
+
+/**
+ *	@brief pack a glyph into the atlas and queue its upload
+ *
+ *	When every page is full and no more can be made, the page
+ *	least recently used is emptied. Pages used this frame are
+ *	never evicted.
+ *
+ *	@param [in] vk the renderer
+ *	@param [in] key not 0 and not in the atlas yet
+ *	@param [in] glyph the glyph's size and format
+ *	@param [in] bitmap the glyph's pixels
+ *	@retval NULL there is no room for the glyph this frame
+ */
+const magma_vk_atlas_glyph_t *magma_vk_atlas_insert(magma_vk_renderer_t *vk, uint64_t key,
+		const magma_glyph_t *glyph, const uint8_t *bitmap);
+
+/**
+ *	@brief copy the glyphs inserted since the last flush to their pages
+ *
+ *	Called by magma_vk_draw before it draws, which also starts
+ *	the next frame. Glyphs are to be inserted by the pass that
+ *	samples the atlas, the software renderer never touches it.
+ *
+ *	@param [in] vk the renderer
+ *	@retval 0 the pages are up to date
+ *	@retval -1 the copy couldn't be submitted
+ */
+int magma_vk_atlas_flush(magma_vk_renderer_t *vk);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Per code point properties, looked up in tables generated
+ * at build time by tools/gen_unicode.py. Each code point has
+ * one byte: the width in bits 0-1, the grapheme break class
+ * in bits 2-5 and Extended_Pictographic in bit 6.
+ */
+
+#define MAGMA_UNICODE_WIDTH_MASK 0x3
+#define MAGMA_UNICODE_GCB_SHIFT 2
+#define MAGMA_UNICODE_GCB_MASK (0xf << MAGMA_UNICODE_GCB_SHIFT)
+#define MAGMA_UNICODE_PICTOGRAPHIC (1 << 6)
+
+/*Grapheme_Cluster_Break, UAX #29*/
+enum magma_gcb {
+	MAGMA_GCB_OTHER,
+	MAGMA_GCB_CR,
+	MAGMA_GCB_LF,
+	MAGMA_GCB_CONTROL,
+	MAGMA_GCB_EXTEND,
+	MAGMA_GCB_ZWJ,
+	MAGMA_GCB_REGIONAL_INDICATOR,
+	MAGMA_GCB_PREPEND,
+	MAGMA_GCB_SPACING_MARK,
+	MAGMA_GCB_L,
+	MAGMA_GCB_V,
+	MAGMA_GCB_T,
+	MAGMA_GCB_LV,
+	MAGMA_GCB_LVT,
+};
+
+/* stage1 picks 64 leaf indices per 4096 code points, stage2
+ * holds them and stage3 the 64 byte leaves
+ */
+extern const uint8_t magma_unicode_stage1[];
+extern const uint16_t magma_unicode_stage2[];
+extern const uint8_t magma_unicode_stage3[];
+
+/**
+ *	@brief get the property byte of a code point
+ *
+ *	@param [in] cp the code point, anything past U+10FFFF is
+ *	treated like U+FFFD
+ */
+static inline uint8_t magma_unicode_props(uint32_t cp) {
+	/*printable ASCII is width 1 and Other, it doesn't need the tables*/
+	if(cp - 0x20 < 0x5f) {
+		return 1;
+	}
+
+	if(cp > 0x10ffff) {
+		cp = 0xfffd;
+	}
+
+	return magma_unicode_stage3[magma_unicode_stage2[magma_unicode_stage1[cp >> 12] * 64 +
+		((cp >> 6) & 63)] * 64 + (cp & 63)];
+}
+
+/**
+ *	@brief number of cells a code point takes up
+ *
+ *	@retval 0 combining marks, format and control characters
+ *	@retval 1 most characters
+ *	@retval 2 East Asian wide and fullwidth characters and emoji
+ */
+static inline int magma_wcwidth(uint32_t cp) {
+	return magma_unicode_props(cp) & MAGMA_UNICODE_WIDTH_MASK;
+}
+
+static inline enum magma_gcb magma_unicode_gcb(uint32_t cp) {
+	return (magma_unicode_props(cp) & MAGMA_UNICODE_GCB_MASK) >> MAGMA_UNICODE_GCB_SHIFT;
+}
@@ -1,25 +1,276 @@
 #pragma once
 
 #include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Size of the reusable buffer the pty master is drained into,
+ * a single read() never asks for more than this.
+ */
+#define MAGMA_VT_READ_SIZE (64 * 1024)
+
+/* Upper bound on what one vt_read_input() call will consume
+ * so a flooding child can't starve input and drawing
+ */
+#define MAGMA_VT_READ_MAX (16 * MAGMA_VT_READ_SIZE)
+
+/* Size of the ring between the reader thread and the parser,
+ * must be a power of two
+ */
+#define MAGMA_VT_RING_SIZE (4 * 1024 * 1024)
+
+/* How long a synchronized update (mode 2026) may hold
+ * back drawing before the frame is shown anyway
+ */
+#define MAGMA_VT_SYNC_TIMEOUT_MS 150
+
+/*magma_vt_t.modes*/
+#define MAGMA_VT_MODE_SYNC (1 << 0)
+/*DEC private modes 47, 1047 and 1049, the alternate screen is shown*/
+#define MAGMA_VT_MODE_ALT (1 << 1)
+
+/* Default number of bytes the scrollback may use,
+ * see magma_vt_set_scrollback
+ */
+#define MAGMA_VT_SCROLLBACK_DEFAULT (32 * 1024 * 1024)
+
+/*columns between the tab stops a new vt starts with*/
+#define MAGMA_VT_TAB_WIDTH 8
+
+/* Number of row moves kept between two frames, moves
+ * of the same region in the same direction are merged
+ */
+#define MAGMA_VT_MAX_MOVES 16
+
+struct magma_vt_reader;
+struct magma_scrollback;
+
 
 typedef uint32_t utf32_t;
 
+/* magma_style_t.attributes, set by SGR. The underline
+ * style is a 3 bit field, 0 means no underline
+ */
+#define MAGMA_ATTR_BOLD (1 << 0)
+#define MAGMA_ATTR_DIM (1 << 1)
+#define MAGMA_ATTR_ITALIC (1 << 2)
+#define MAGMA_ATTR_BLINK (1 << 3)
+#define MAGMA_ATTR_INVERSE (1 << 4)
+#define MAGMA_ATTR_INVISIBLE (1 << 5)
+#define MAGMA_ATTR_STRIKE (1 << 6)
+#define MAGMA_ATTR_OVERLINE (1 << 7)
+#define MAGMA_ATTR_UNDERLINE_SHIFT 8
+#define MAGMA_ATTR_UNDERLINE (7 << MAGMA_ATTR_UNDERLINE_SHIFT)
+
+enum magma_underline {
+	MAGMA_UNDERLINE_NONE,
+	MAGMA_UNDERLINE_SINGLE,
+	MAGMA_UNDERLINE_DOUBLE,
+	MAGMA_UNDERLINE_CURLY,
+	MAGMA_UNDERLINE_DOTTED,
+	MAGMA_UNDERLINE_DASHED,
+};
+
+/* magma_style_t.fg and bg, the top byte says how to read the
+ * low 24 bits: nothing, a palette index, or 0xRRGGBB.
+ * Resolved to ARGB with magma_vt_color_resolve at draw time
+ */
+#define MAGMA_COLOR_DEFAULT 0
+#define MAGMA_COLOR_TYPE_INDEXED 1
+#define MAGMA_COLOR_TYPE_RGB 2
+
+#define MAGMA_COLOR_TYPE(color) ((color) >> 24)
+#define MAGMA_COLOR_INDEXED(index) ((uint32_t)MAGMA_COLOR_TYPE_INDEXED << 24 | (uint8_t)(index))
+#define MAGMA_COLOR_RGB(r, g, b) ((uint32_t)MAGMA_COLOR_TYPE_RGB << 24 | \
+		(uint32_t)(uint8_t)(r) << 16 | (uint32_t)(uint8_t)(g) << 8 | (uint8_t)(b))
+
+/*ARGB used for MAGMA_COLOR_DEFAULT*/
+#define MAGMA_VT_DEFAULT_FG 0xfff8f8f2
+#define MAGMA_VT_DEFAULT_BG 0xff000000
+
+/* glyph_t.flags, a wide character's cell is followed by a
+ * tail cell without a character of its own
+ */
+#define MAGMA_GLYPH_WIDE (1 << 0)
+#define MAGMA_GLYPH_WIDE_TAIL (1 << 1)
+
+/* glyph_t.unicode with this bit set is the id of a grapheme
+ * cluster in magma_vt_t.clusters instead of a code point
+ */
+#define MAGMA_GLYPH_CLUSTER (1u << 31)
+
+/*8 bytes, the style index points into magma_vt_t.styles*/
 typedef struct {
 	utf32_t unicode;
+	uint16_t style;
+	uint16_t flags;
+} glyph_t;
 
+/* What a cell looks like apart from its character, shared
+ * by every cell with the same SGR state through the style
+ * table so a cell only carries the index
+ */
+typedef struct {
 	uint32_t attributes;
-	/* we dont support true color yet
-	 * but lets just have the correct 
-	 * color width in case we need to 
-	 * implement it
-	 */
 	uint32_t fg, bg;
-} glyph_t;
+} magma_style_t;
+
+/* Interned styles, index 0 is always the default style
+ * so zeroed cells are blank. Unused entries are collected
+ * when the table fills up
+ */
+typedef struct {
+	magma_style_t *entries;
+	uint32_t capacity, count;
+
+	/*open addressed, holds indices into entries, 0 is empty*/
+	uint16_t *hash;
+	uint32_t hash_mask;
+
+	/*entries freed by the last collection*/
+	uint16_t *free_list;
+	uint32_t n_free;
+
+	/*cells outside the grid that a collection must keep alive*/
+	const glyph_t *pinned;
+	size_t n_pinned;
+} magma_styles_t;
+
+typedef struct {
+	uint32_t offset, len;
+} magma_cluster_t;
+
+/* Interned grapheme clusters of more than one code point,
+ * their code points are kept back to back in data. id 0 is
+ * never used. Clusters no cell refers to anymore are collected
+ * and data compacted when either fills up
+ */
+typedef struct {
+	utf32_t *data;
+	size_t data_used, data_size;
+
+	/*where each id's code points are in data, len is 0 when free*/
+	magma_cluster_t *entries;
+	uint32_t capacity, count;
+
+	/*open addressed, holds ids, 0 is empty*/
+	uint32_t *hash;
+	uint32_t hash_mask;
+
+	uint32_t *free_list;
+	uint32_t n_free;
+
+	/*cells outside the grid that a collection must keep alive*/
+	const glyph_t *pinned;
+	size_t n_pinned;
+
+	/*counts collections, an id seen before one may mean another cluster now*/
+	uint32_t generation;
+} magma_clusters_t;
+
 
 typedef glyph_t *line_t;
 
+/* State kept per grid row, moves with the row when it
+ * scrolls. x0 to x1 (exclusive) are the columns changed
+ * since the renderer last looked, x0 >= x1 when clean.
+ * Every cell from used on is blank
+ */
+typedef struct {
+	uint16_t damage_x0, damage_x1;
+	uint16_t flags;
+	uint16_t used;
+} magma_vt_row_t;
+
+/*the row ran out of columns and continues on the next one*/
+#define MAGMA_ROW_WRAPPED (1 << 0)
+
+/*DECSC, the cursor and the pen it draws with*/
+typedef struct {
+	int x, y;
+	uint32_t fg, bg, attributes;
+	uint16_t style;
+} magma_vt_cursor_t;
+
+/* One screen. rows x cols cells in one allocation, lines
+ * points at each row. The visible screen is a ring starting
+ * at lines[head] so scrolling moves head instead of cells
+ */
+typedef struct {
+	int rows, cols;
+	glyph_t *slab;
+	line_t *lines;
+	magma_vt_row_t *meta;
+	int head;
+
+	/* rows that are all blank point at blank, one row of
+	 * zeroed cells mapped read only, and their own cells wait
+	 * in spare until the row is written to
+	 */
+	const glyph_t *blank;
+	size_t blank_size;
+	glyph_t **spare;
+	int n_spare;
+
+	/* slab pages with only spare rows on them are given back
+	 * to the kernel, released[p] is set while page p is and
+	 * released_size is how many bytes that is. spare_scan is
+	 * n_spare when they were last looked for
+	 */
+	uint8_t *released;
+	size_t n_pages, released_size;
+	int spare_scan;
+
+	/*each screen saves its own cursor*/
+	magma_vt_cursor_t saved;
+} magma_vt_grid_t;
+
+/* Rows top to bottom (inclusive) were scrolled by count,
+ * up when positive and down when negative. The rows that
+ * scrolled in are blank, everything else in the region
+ * only changed position and can be copied on screen
+ */
+typedef struct {
+	int top, bottom;
+	int count;
+} magma_vt_move_t;
+
+/* State of the UTF8 decoder between two reads,
+ * need is 0 when no character is in progress
+ */
+typedef struct {
+	utf32_t codepoint;
+	uint8_t need, seen;
+	uint8_t lower, upper;
+} magma_utf8_t;
+
+#define MAGMA_VT_MAX_PARAMS 16
+#define MAGMA_VT_MAX_INTERMEDIATES 2
+#define MAGMA_VT_OSC_MAX 512
+
+/* State of the escape sequence parser, everything needed
+ * to pick up a sequence that was split across two reads
+ */
+typedef struct {
+	uint8_t state;
+
+	uint8_t n_intermediates;
+	uint8_t intermediates[MAGMA_VT_MAX_INTERMEDIATES];
+
+	/* bit n of subparams is set when params[n] was 
+	 * separated from the one before it by a ':' 
+	 */
+	uint8_t n_params;
+	uint16_t subparams;
+	uint16_t params[MAGMA_VT_MAX_PARAMS];
+
+	uint16_t osc_len;
+	char osc[MAGMA_VT_OSC_MAX];
+
+	magma_utf8_t utf8;
+} magma_vt_parser_t;
+
 typedef struct {
 	int master;
 
@@ -28,11 +279,64 @@ typedef struct {
 	int buf_x;
 	int buf_y;
 
+	/* a character filled the last column, the cursor stays on
+	 * it until the next character wraps to the next row
+	 */
+	bool wrap_pending;
+
+	/*SGR state and its interned index in styles*/
 	uint32_t fg;
 	uint32_t bg;
 	uint32_t attributes;
-	
-	line_t *lines;
+	uint16_t style;
+
+	/* last character printed, what REP repeats, and the
+	 * properties of its last code point, see magma/unicode.h
+	 */
+	utf32_t last;
+	uint8_t last_props;
+
+	magma_styles_t styles;
+
+	uint32_t modes;
+	/*CLOCK_MONOTONIC ns of the first update held back, 0 if none*/
+	uint64_t sync_start;
+
+	/* the screen shown and the other one, other is NULL
+	 * until the alternate screen is first used. Switching
+	 * swaps the two pointers
+	 */
+	magma_vt_grid_t *grid, *other;
+
+	/*set when any row was damaged or moved, cleared by the renderer*/
+	bool dirty;
+
+	/*DECSTBM margins, rows scroll_top to scroll_bottom inclusive*/
+	int scroll_top, scroll_bottom;
+
+	/*tabs[x] is set when column x has a tab stop*/
+	bool *tabs;
+
+	/* lines that scrolled off the top, view is how many
+	 * of them are shown above the screen, 0 when following
+	 * the output
+	 */
+	struct magma_scrollback *scrollback;
+	size_t view;
+
+	/* moves since the renderer last looked, n_moves is
+	 * MAGMA_VT_MAX_MOVES + 1 when some were lost
+	 */
+	int n_moves;
+	magma_vt_move_t moves[MAGMA_VT_MAX_MOVES];
+
+	magma_vt_parser_t parser;
+	uint8_t *read_buf;
+
+	/*NULL unless input is read on a separate thread*/
+	struct magma_vt_reader *reader;
+
+	magma_clusters_t clusters;
 } magma_vt_t;
 
 
@@ -58,4 +362,255 @@ int magma_get_pty(int *pmaster, int *pslave);
  *	@retval -1 fork() failed
  */
 pid_t magma_fork_pty(const int master, int *slave);
-void vt_read_input(magma_vt_t *magvt);
+
+/**
+ *	@brief allocate a vt with a rows x cols grid
+ *
+ *	master is set to -1 and should be filled by the caller
+ *
+ *	@param [in] rows number of rows in the grid
+ *	@param [in] cols number of columns in the grid
+ *	@retval NULL allocation failed
+ *	@retval !NULL a pointer to the vt structure
+ */
+magma_vt_t *magma_vt_init(int rows, int cols);
+void magma_vt_deinit(magma_vt_t *vt);
+
+/**
+ *	@brief get a row of the visible screen
+ *
+ *	@param [in] vt the vt
+ *	@param [in] y row counted from the top of the screen
+ *	@return the cols cells of the row
+ */
+static inline line_t magma_vt_line(const magma_vt_t *vt, int y) {
+	int index = vt->grid->head + y;
+
+	if(index >= vt->rows) {
+		index -= vt->rows;
+	}
+
+	return vt->grid->lines[index];
+}
+
+/**
+ *	@brief get the per row state of a row of the visible screen
+ *
+ *	@param [in] vt the vt
+ *	@param [in] y row counted from the top of the screen
+ */
+static inline magma_vt_row_t *magma_vt_row(const magma_vt_t *vt, int y) {
+	int index = vt->grid->head + y;
+
+	if(index >= vt->rows) {
+		index -= vt->rows;
+	}
+
+	return &vt->grid->meta[index];
+}
+
+/**
+ *	@brief mark columns x0 to x1 (exclusive) of row y as changed
+ *
+ *	@param [in] vt the vt
+ *	@param [in] y row counted from the top of the screen
+ *	@param [in] x0 first column
+ *	@param [in] x1 column after the last one
+ */
+static inline void magma_vt_damage(magma_vt_t *vt, int y, int x0, int x1) {
+	magma_vt_row_t *row = magma_vt_row(vt, y);
+
+	if(row->damage_x0 >= row->damage_x1) {
+		row->damage_x0 = x0;
+		row->damage_x1 = x1;
+	} else {
+		if(x0 < row->damage_x0) row->damage_x0 = x0;
+		if(x1 > row->damage_x1) row->damage_x1 = x1;
+	}
+
+	vt->dirty = true;
+}
+
+/**
+ *	@brief get and clear the damage of a row
+ *
+ *	@param [in] vt the vt
+ *	@param [in] y row counted from the top of the screen
+ *	@param [out] x0 first damaged column
+ *	@param [out] x1 column after the last damaged one
+ *	@retval true the row has damage
+ *	@retval false the row didn't change
+ */
+bool magma_vt_take_damage(magma_vt_t *vt, int y, int *x0, int *x1);
+
+/*drop the row moves and damage, the whole screen has to be redrawn*/
+void magma_vt_damage_all(magma_vt_t *vt);
+
+/**
+ *	@brief look up the style of a cell
+ *
+ *	@param [in] vt the vt the cell belongs to
+ *	@param [in] index glyph_t.style of the cell
+ */
+static inline const magma_style_t *magma_vt_style(const magma_vt_t *vt, uint16_t index) {
+	return &vt->styles.entries[index];
+}
+
+/**
+ *	@brief get the code points of a cell
+ *
+ *	@param [in] vt the vt the cell belongs to
+ *	@param [in] cell the cell
+ *	@param [out] len number of code points
+ *	@return the code points, the base character first
+ */
+static inline const utf32_t *magma_vt_cluster(const magma_vt_t *vt, const glyph_t *cell, int *len) {
+	const magma_cluster_t *cluster;
+
+	if(!(cell->unicode & MAGMA_GLYPH_CLUSTER)) {
+		*len = 1;
+		return &cell->unicode;
+	}
+
+	cluster = &vt->clusters.entries[cell->unicode & ~MAGMA_GLYPH_CLUSTER];
+	*len = cluster->len;
+	return &vt->clusters.data[cluster->offset];
+}
+
+/**
+ *	@brief get a row as it should be shown
+ *
+ *	Same as magma_vt_line when the view isn't scrolled back,
+ *	otherwise the top rows come from the scrollback.
+ *
+ *	@param [in] vt the vt
+ *	@param [in] y row counted from the top of the window
+ *	@param [in] scratch cols cells a scrollback row is copied into
+ *	@param [out] used the cells from this column on are blank
+ *	@return the cols cells of the row, either a grid row or scratch
+ */
+line_t magma_vt_view_line(magma_vt_t *vt, int y, glyph_t *scratch, int *used);
+
+/**
+ *	@brief move the view into the scrollback
+ *
+ *	@param [in] vt the vt
+ *	@param [in] delta lines to move, positive goes back in history
+ */
+void magma_vt_scroll_view(magma_vt_t *vt, long delta);
+
+/**
+ *	@brief change how much memory the scrollback may use
+ *
+ *	The oldest lines are dropped to fit, 0 disables it.
+ *
+ *	@param [in] vt the vt
+ *	@param [in] budget size in bytes
+ */
+void magma_vt_set_scrollback(magma_vt_t *vt, size_t budget);
+
+/**
+ *	@brief change the size of the grid
+ *
+ *	Cells are kept where they fit, when rows are lost
+ *	the ones at the top are dropped so the cursor stays
+ *	on screen. Doesn't tell the child, that is left to
+ *	the caller.
+ *
+ *	@param [in] vt the vt to resize
+ *	@param [in] rows new number of rows
+ *	@param [in] cols new number of columns
+ *	@retval 0 success
+ *	@retval -1 allocation failed, the grid is unchanged
+ */
+int magma_vt_resize(magma_vt_t *vt, int rows, int cols);
+
+/**
+ *	@brief get the row moves since the last call
+ *
+ *	The moves are cleared by the call, apply them in order
+ *	before redrawing the damaged rows. No moves are recorded
+ *	while the view is scrolled back since the window doesn't
+ *	change then.
+ *
+ *	@param [in] vt the vt
+ *	@param [out] moves set to the recorded moves
+ *	@retval >=0 number of moves
+ *	@retval -1 too many moves were made, redraw everything
+ */
+int magma_vt_take_moves(magma_vt_t *vt, const magma_vt_move_t **moves);
+
+/**
+ *	@brief turn a packed glyph color into ARGB
+ *
+ *	Indexed colors are looked up in the xterm 256 color
+ *	palette, 0-15 being the standard and bright colors,
+ *	16-231 the 6x6x6 cube and 232-255 the gray ramp.
+ *
+ *	@param [in] color a MAGMA_COLOR_* value
+ *	@param [in] def ARGB returned for MAGMA_COLOR_DEFAULT
+ *	@return the color as 0xAARRGGBB
+ */
+uint32_t magma_vt_color_resolve(uint32_t color, uint32_t def);
+
+/**
+ *	@brief parse a chunk of bytes from the child into the grid
+ *
+ *	Every byte is consumed, a sequence cut off at the end of 
+ *	the chunk is kept in the parser state and finished by the
+ *	next call.
+ *
+ *	@param [in] vt the vt to update
+ *	@param [in] buf bytes read from the pty
+ *	@param [in] len number of bytes in buf
+ */
+void magma_vt_parse(magma_vt_t *vt, const uint8_t *buf, size_t len);
+
+/**
+ *	@brief check if drawing should wait for the application
+ *
+ *	True while a synchronized update (CSI ? 2026 h) is in progress.
+ *	After MAGMA_VT_SYNC_TIMEOUT_MS the mode is dropped so a
+ *	client that never ends the update can't freeze the screen.
+ *
+ *	@param [in] vt the vt about to be drawn
+ *	@retval true skip this frame
+ *	@retval false draw
+ */
+bool magma_vt_frame_held(magma_vt_t *vt);
+
+/**
+ *	@brief start a thread draining the pty master into a ring
+ *
+ *	Once started vt_read_input() parses from the ring instead 
+ *	of reading the master, and magma_vt_get_fd() returns a fd
+ *	that becomes readable when the ring has data.
+ *
+ *	@param [in] vt the vt to read for, master must be set
+ *	@retval 0 success
+ *	@retval -1 failed to set up the ring or thread
+ */
+int magma_vt_reader_start(magma_vt_t *vt);
+void magma_vt_reader_stop(magma_vt_t *vt);
+
+/**
+ *	@brief get the fd to poll for input
+ *
+ *	@return the pty master, or the reader thread's
+ *	notification fd when it is running
+ */
+int magma_vt_get_fd(magma_vt_t *vt);
+
+/**
+ *	@brief drain the pty master and parse what was read
+ *
+ *	The master must be non-blocking, reads are done in chunks of
+ *	MAGMA_VT_READ_SIZE until the pty is empty or MAGMA_VT_READ_MAX
+ *	bytes have been consumed. With the reader thread running the
+ *	ring is consumed instead, in batches of up to MAGMA_VT_READ_MAX.
+ *
+ *	@param [in] vt the vt to read into
+ *	@retval >=0 number of bytes read
+ *	@retval -1 the child hung up or read() failed
+ */
+ssize_t vt_read_input(magma_vt_t *vt);
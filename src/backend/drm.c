@@ -223,7 +223,6 @@ void magma_drm_backend_put_buffer(magma_backend_t *backend, magma_buf_t *buffer)
 	magma_drm_backend_t *drm = (void*)backend;
 
 	memcpy(drm->fb->data, buffer->buffer, buffer->width * buffer->height * 4);
-	free(buffer->buffer);
 }
 
 /* Linux will prevent us from playing with the 
@@ -219,7 +219,6 @@ void magma_wl_backend_put_buffer(magma_backend_t *backend, magma_buf_t *buffer)
 
 	munmap(data, buffer->pitch * buffer->height);
 
-	free(buffer->buffer);
 	wl_surface_damage_buffer(wl->surface, 0, 0, buffer->width, buffer->height);
 
 	wl_surface_attach(wl->surface, buf, 0, 0);
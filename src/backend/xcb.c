@@ -119,12 +119,13 @@ struct xkb_state *magma_xcb_backend_get_xkbstate(magma_backend_t *backend, struc
 void magma_xcb_backend_put_buffer(magma_backend_t *backend, magma_buf_t *buffer) {
 	magma_xcb_backend_t *xcb = (void *)backend;
 
-	xcb_image_t *image = xcb_image_create(buffer->width, buffer->height, XCB_IMAGE_FORMAT_Z_PIXMAP, buffer->bpp, xcb->depth, buffer->bpp, buffer->bpp, 0, XCB_IMAGE_ORDER_LSB_FIRST, buffer->buffer, buffer->width * buffer->height * 4, buffer->buffer);
+	xcb_image_t *image = xcb_image_create(buffer->width, buffer->height, XCB_IMAGE_FORMAT_Z_PIXMAP, buffer->bpp, xcb->depth, buffer->bpp, buffer->bpp, 0, XCB_IMAGE_ORDER_LSB_FIRST, NULL, buffer->width * buffer->height * 4, buffer->buffer);
 
 
 
 	xcb_image_put(xcb->connection, xcb->window, xcb->gc, image, 0, 0, 0);
 
+	/*no base so the caller keeps the pixels*/
 	xcb_image_destroy(image);
 }
 
@@ -0,0 +1,293 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <magma/blit.h>
+
+/* A row kernel draws n pixels of one glyph row starting at glyph
+ * column x into dst. BLIT_GLYPH wraps one in the clipping and row
+ * loop so every format gets a loop with its kernel inlined.
+ */
+
+#define BLIT_GLYPH(name, row) \
+	static void name(magma_buf_t *buf, const magma_glyph_t *glyph, const uint8_t *bitmap, \
+			int x, int y, uint32_t fg) { \
+		int x0 = 0, x1 = glyph->width, y0 = 0, y1 = glyph->rows; \
+		\
+		x += glyph->left; \
+		y -= glyph->top; \
+		if(x < 0) { \
+			x0 = -x; \
+		} \
+		if(x + x1 > (int)buf->width) { \
+			x1 = (int)buf->width - x; \
+		} \
+		if(y < 0) { \
+			y0 = -y; \
+		} \
+		if(y + y1 > (int)buf->height) { \
+			y1 = (int)buf->height - y; \
+		} \
+		\
+		for(int yp = y0; yp < y1 && x0 < x1; yp++) { \
+			row((uint32_t *)((uint8_t *)buf->buffer + (size_t)(y + yp) * buf->pitch) + x + x0, \
+					&bitmap[yp * glyph->pitch], x0, x1 - x0, fg); \
+		} \
+	}
+
+/*1 bit per pixel, a set bit is fg and a clear one leaves dst*/
+static inline void blit_row_mono(uint32_t *dst, const uint8_t *src, int x, int n, uint32_t fg) {
+	int i = 0;
+
+	/*up to the next whole byte of bits*/
+	for(; i < n && (x + i) & 7; i++) {
+		if(src[(x + i) >> 3] & (0x80 >> ((x + i) & 7))) {
+			dst[i] = fg;
+		}
+	}
+
+#if defined(__AVX2__)
+	const __m256i bits8 = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m256i fg8 = _mm256_set1_epi32(fg);
+
+	for(; i + 8 <= n; i += 8) {
+		uint8_t byte = src[(x + i) >> 3];
+		__m256i mask, pixels;
+
+		if(!byte) {
+			continue;
+		}
+		mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(byte), bits8), bits8);
+		pixels = _mm256_loadu_si256((const __m256i *)&dst[i]);
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_blendv_epi8(pixels, fg8, mask));
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+	const __m128i lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+	const __m128i fg4 = _mm_set1_epi32(fg);
+
+	for(; i + 8 <= n; i += 8) {
+		uint8_t byte = src[(x + i) >> 3];
+		__m128i bits, mask, pixels;
+
+		if(!byte) {
+			continue;
+		}
+		bits = _mm_set1_epi32(byte);
+
+		mask = _mm_cmpeq_epi32(_mm_and_si128(bits, hi), hi);
+		pixels = _mm_loadu_si128((const __m128i *)&dst[i]);
+		pixels = _mm_or_si128(_mm_and_si128(mask, fg4), _mm_andnot_si128(mask, pixels));
+		_mm_storeu_si128((__m128i *)&dst[i], pixels);
+
+		mask = _mm_cmpeq_epi32(_mm_and_si128(bits, lo), lo);
+		pixels = _mm_loadu_si128((const __m128i *)&dst[i + 4]);
+		pixels = _mm_or_si128(_mm_and_si128(mask, fg4), _mm_andnot_si128(mask, pixels));
+		_mm_storeu_si128((__m128i *)&dst[i + 4], pixels);
+	}
+#endif
+
+	for(; i < n; i++) {
+		if(src[(x + i) >> 3] & (0x80 >> ((x + i) & 7))) {
+			dst[i] = fg;
+		}
+	}
+}
+
+/* Coverage is blended in linear light, blending the sRGB values
+ * directly makes light text on a dark background look thin. The
+ * sRGB curve is approximated with a gamma of 2, so going to linear
+ * is a square and coming back a square root:
+ *
+ *	out = sqrt(dst^2 + (fg^2 - dst^2) * a / 255)
+ */
+
+#if defined(__SSE2__)
+/*blend the 4 channels of one pixel, widened to 32 bit lanes*/
+static inline __m128i blit_blend_pixel(__m128i px, __m128 fg2, __m128 a) {
+	__m128 d = _mm_cvtepi32_ps(px);
+
+	d = _mm_mul_ps(d, d);
+	d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(fg2, d), a));
+	return _mm_cvtps_epi32(_mm_sqrt_ps(d));
+}
+
+/*blend 4 pixels, a holds their coverage in the low 4 bytes*/
+static inline __m128i blit_blend4(__m128i dst, __m128 fg2, __m128i a) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo, hi, p0, p1, p2, p3;
+	__m128 alpha;
+
+	alpha = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(a, zero), zero));
+	alpha = _mm_mul_ps(alpha, _mm_set1_ps(1.0f / 255));
+
+	lo = _mm_unpacklo_epi8(dst, zero);
+	hi = _mm_unpackhi_epi8(dst, zero);
+	p0 = blit_blend_pixel(_mm_unpacklo_epi16(lo, zero), fg2, _mm_shuffle_ps(alpha, alpha, _MM_SHUFFLE(0, 0, 0, 0)));
+	p1 = blit_blend_pixel(_mm_unpackhi_epi16(lo, zero), fg2, _mm_shuffle_ps(alpha, alpha, _MM_SHUFFLE(1, 1, 1, 1)));
+	p2 = blit_blend_pixel(_mm_unpacklo_epi16(hi, zero), fg2, _mm_shuffle_ps(alpha, alpha, _MM_SHUFFLE(2, 2, 2, 2)));
+	p3 = blit_blend_pixel(_mm_unpackhi_epi16(hi, zero), fg2, _mm_shuffle_ps(alpha, alpha, _MM_SHUFFLE(3, 3, 3, 3)));
+
+	return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+}
+
+static inline __m128 blit_linear_fg(uint32_t fg) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128 f;
+
+	f = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(fg), zero), zero));
+	return _mm_mul_ps(f, f);
+}
+#else
+/*square root rounded to the nearest integer*/
+static inline uint32_t blit_sqrt(uint32_t v) {
+	uint32_t root = 0, bit = 1 << 16;
+
+	while(bit > v) {
+		bit >>= 2;
+	}
+	for(; bit; bit >>= 2) {
+		if(v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+	}
+
+	return v > root ? root + 1 : root;
+}
+
+static inline uint32_t blit_blend(uint32_t dst, uint32_t fg, uint32_t a) {
+	uint32_t out = 0;
+	int32_t f, d;
+
+	for(int shift = 0; shift < 32; shift += 8) {
+		f = (fg >> shift) & 0xff;
+		d = (dst >> shift) & 0xff;
+		out |= blit_sqrt(d * d + (f * f - d * d) * (int32_t)a / 255) << shift;
+	}
+
+	return out;
+}
+#endif
+
+#if defined(__AVX2__)
+/*blend 2 pixels, widened to 32 bit lanes*/
+static inline __m256i blit_blend_pixel2(__m256i px, __m256 fg2, __m256 a) {
+	__m256 d = _mm256_cvtepi32_ps(px);
+
+	d = _mm256_mul_ps(d, d);
+	d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(fg2, d), a));
+	return _mm256_cvtps_epi32(_mm256_sqrt_ps(d));
+}
+
+/*blit_blend4 for 8 pixels, a holds their coverage in the low 8 bytes*/
+static inline __m256i blit_blend8(const uint32_t *dst, __m256 fg2, __m128i a) {
+	__m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(a)), _mm256_set1_ps(1.0f / 255));
+	__m256i p[4];
+
+	for(int k = 0; k < 4; k++) {
+		__m256i spread = _mm256_setr_epi32(2 * k, 2 * k, 2 * k, 2 * k, 2 * k + 1, 2 * k + 1, 2 * k + 1, 2 * k + 1);
+
+		p[k] = blit_blend_pixel2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&dst[2 * k])),
+				fg2, _mm256_permutevar8x32_ps(alpha, spread));
+	}
+
+	/*packing works within 128 bit lanes, which leaves the pixels as 0 2 4 6 1 3 5 7*/
+	return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(_mm256_packs_epi32(p[0], p[1]),
+			_mm256_packs_epi32(p[2], p[3])), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+#endif
+
+/*1 byte of coverage per pixel, fg is blended over dst*/
+static inline void blit_row_gray(uint32_t *dst, const uint8_t *src, int x, int n, uint32_t fg) {
+	int i = 0;
+
+	src += x;
+
+#if defined(__SSE2__)
+	const __m128 fg2 = blit_linear_fg(fg);
+	const __m128i fg4 = _mm_set1_epi32(fg);
+#endif
+
+#if defined(__AVX2__)
+	const __m256 fg2x = _mm256_set_m128(fg2, fg2);
+	const __m256i fg8 = _mm256_set1_epi32(fg);
+
+	for(; i + 8 <= n; i += 8) {
+		uint64_t a;
+
+		memcpy(&a, &src[i], sizeof(a));
+		if(a == 0) {
+			continue;
+		}
+		if(a == UINT64_MAX) {
+			_mm256_storeu_si256((__m256i *)&dst[i], fg8);
+			continue;
+		}
+
+		_mm256_storeu_si256((__m256i *)&dst[i], blit_blend8(&dst[i], fg2x, _mm_loadl_epi64((const __m128i *)&src[i])));
+	}
+#endif
+
+#if defined(__SSE2__)
+	for(; i + 4 <= n; i += 4) {
+		uint32_t a;
+
+		memcpy(&a, &src[i], sizeof(a));
+		/*most of a glyph's box is empty or solid*/
+		if(a == 0) {
+			continue;
+		}
+		if(a == 0xffffffff) {
+			_mm_storeu_si128((__m128i *)&dst[i], fg4);
+			continue;
+		}
+
+		_mm_storeu_si128((__m128i *)&dst[i], blit_blend4(_mm_loadu_si128((const __m128i *)&dst[i]),
+				fg2, _mm_cvtsi32_si128(a)));
+	}
+
+	/*the last 1 to 3 pixels go through the same path padded out to 4*/
+	if(i < n) {
+		uint32_t pixels[4] = { 0 }, a = 0;
+
+		memcpy(pixels, &dst[i], (n - i) * sizeof(uint32_t));
+		memcpy(&a, &src[i], n - i);
+		if(a) {
+			_mm_storeu_si128((__m128i *)pixels, blit_blend4(_mm_loadu_si128((const __m128i *)pixels),
+					fg2, _mm_cvtsi32_si128(a)));
+			memcpy(&dst[i], pixels, (n - i) * sizeof(uint32_t));
+		}
+	}
+#else
+	for(; i < n; i++) {
+		if(src[i] == 0xff) {
+			dst[i] = fg;
+		} else if(src[i]) {
+			dst[i] = blit_blend(dst[i], fg, src[i]);
+		}
+	}
+#endif
+}
+
+BLIT_GLYPH(blit_glyph_mono, blit_row_mono)
+BLIT_GLYPH(blit_glyph_gray, blit_row_gray)
+
+void magma_blit_glyph(magma_buf_t *buf, const magma_glyph_t *glyph, const uint8_t *bitmap,
+		int x, int y, uint32_t fg) {
+	switch(glyph->format) {
+		case MAGMA_GLYPH_FORMAT_MONO:
+			blit_glyph_mono(buf, glyph, bitmap, x, y, fg);
+			break;
+		case MAGMA_GLYPH_FORMAT_GRAY:
+			blit_glyph_gray(buf, glyph, bitmap, x, y, fg);
+			break;
+	}
+}
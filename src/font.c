@@ -12,8 +12,8 @@
 
 #include <stdlib.h>
 
-/*Find font or subsitute from fconfig_str*/
-static char *magma_fconfig_find_sub(FcConfig *config, const char *fconfig_str) {
+/*Find font or subsitute from fconfig_str in the given style*/
+static char *magma_fconfig_find_sub(FcConfig *config, const char *fconfig_str, int style, int *index) {
 	FcPattern *pattern, *font;
 	FcChar8 *fc_file;
 	FcResult result;
@@ -22,6 +22,12 @@ static char *magma_fconfig_find_sub(FcConfig *config, const char *fconfig_str) {
 	font_file = NULL;
 
 	pattern = FcNameParse((const FcChar8*)fconfig_str);
+	if(style & MAGMA_FONT_BOLD) {
+		FcPatternAddInteger(pattern, FC_WEIGHT, FC_WEIGHT_BOLD);
+	}
+	if(style & MAGMA_FONT_ITALIC) {
+		FcPatternAddInteger(pattern, FC_SLANT, FC_SLANT_ITALIC);
+	}
 	FcConfigSubstitute(config, pattern, FcMatchPattern);
 	FcDefaultSubstitute(pattern);
 
@@ -31,16 +37,60 @@ static char *magma_fconfig_find_sub(FcConfig *config, const char *fconfig_str) {
 			font_file = strdup((char*)fc_file);
 			magma_log_debug("Font file used: %s\n", font_file);
 		}
+		if(FcPatternGetInteger(font, FC_INDEX, 0, index) != FcResultMatch) {
+			*index = 0;
+		}
 	}
 	FcPatternDestroy(font);
 	FcPatternDestroy(pattern);
 	return font_file;
 }
 
+/* load the face of a style, sharing the face of an earlier style
+ * from the same file. fontconfig hands out the closest face when
+ * the style is missing and marks it as synthetic by changing the
+ * slant, so what the face really is comes from its own flags
+ */
+static FT_Face magma_font_load_style(magma_font_t *font, const char *fconfig_str, int style,
+		char *files[MAGMA_FONT_STYLES], int indices[MAGMA_FONT_STYLES]) {
+	FT_Error ft_error;
+	FT_Face face = NULL;
+
+	files[style] = magma_fconfig_find_sub(font->font_config, fconfig_str, style, &indices[style]);
+	if(!files[style]) {
+		return NULL;
+	}
+
+	for(int i = 0; i < style && !face; i++) {
+		if(files[i] && indices[i] == indices[style] && !strcmp(files[i], files[style])) {
+			FT_Reference_Face(font->faces[i]);
+			face = font->faces[i];
+		}
+	}
+
+	if(!face) {
+		ft_error = FT_New_Face(font->ft_lib, files[style], indices[style], &face);
+		if(ft_error) {
+			magma_log_error("Failed to create FT Face for %s: %s\n", files[style], FT_Error_String(ft_error));
+			return NULL;
+		}
+	}
+
+	font->synthetic[style] = style;
+	if(face->style_flags & FT_STYLE_FLAG_BOLD) {
+		font->synthetic[style] &= ~MAGMA_FONT_BOLD;
+	}
+	if(face->style_flags & FT_STYLE_FLAG_ITALIC) {
+		font->synthetic[style] &= ~MAGMA_FONT_ITALIC;
+	}
+	return face;
+}
+
 magma_font_t *magma_font_init(const char *fconfig_str) {
 	FT_Error ft_error;
 	const char *ft_error_str;
-	char *font_file;
+	char *files[MAGMA_FONT_STYLES] = { 0 };
+	int indices[MAGMA_FONT_STYLES] = { 0 };
 	magma_font_t *font;
 	
 
@@ -63,17 +113,27 @@ magma_font_t *magma_font_init(const char *fconfig_str) {
 		goto err_fc_config_and_fonts;
 	}
 
-	font_file = magma_fconfig_find_sub(font->font_config, fconfig_str);
-	if(!font_file) {
+	font->faces[0] = magma_font_load_style(font, fconfig_str, 0, files, indices);
+	if(!font->faces[0]) {
 		magma_log_error("Failed to find fallback font for %s\n", fconfig_str);
 		goto err_font_file;
 	}
-	
-	magma_log_debug("%s\n", font_file);
-	ft_error = FT_New_Face(font->ft_lib, font_file, 0, &font->face);
-	free(font_file);
-	if(ft_error) {
-		magma_log_error("Failed to create FT Face: %d\n", FT_Error_String(ft_error));
+
+	/*a missing style falls back to drawing the regular face differently*/
+	for(int style = 1; style < MAGMA_FONT_STYLES; style++) {
+		font->faces[style] = magma_font_load_style(font, fconfig_str, style, files, indices);
+		if(!font->faces[style]) {
+			free(files[style]);
+			files[style] = NULL;
+			FT_Reference_Face(font->faces[0]);
+			font->faces[style] = font->faces[0];
+			font->synthetic[style] = style;
+		}
+		magma_log_debug("Font style %d synthetic %d\n", style, font->synthetic[style]);
+	}
+
+	for(int style = 0; style < MAGMA_FONT_STYLES; style++) {
+		free(files[style]);
 	}
 
 	/*2 issues here.
@@ -81,11 +141,13 @@ magma_font_t *magma_font_init(const char *fconfig_str) {
 	 * Or if the users a vertical font but we don't support that anyway
 	 * so for now thats fine 
 	 */
-	font->advance.x = font->face->max_advance_width >> 6;
-	font->height = font->face->max_advance_height >> 6;
+	font->advance.x = font->faces[0]->max_advance_width >> 6;
+	font->height = font->faces[0]->max_advance_height >> 6;
 	return font;
 
 err_font_file:
+	free(files[0]);
+	FcConfigDestroy(font->font_config);
 err_fc_config_and_fonts:
 	FT_Done_FreeType(font->ft_lib);
 err_ft_init:
@@ -94,9 +156,38 @@ err_font_alloc:
 	return NULL;
 }
 
+int magma_font_set_size(magma_font_t *font, uint32_t size) {
+	FT_Face face = font->faces[0];
+
+	for(int style = 0; style < MAGMA_FONT_STYLES; style++) {
+		if(FT_Set_Pixel_Sizes(font->faces[style], size, size) && style == 0) {
+			magma_log_error("Failed to set font size to %u\n", size);
+			return -1;
+		}
+	}
+
+	font->height = face->size->metrics.height >> 6;
+
+	/* Get the size of the M character to use as the advance width 
+	 * as it will improve readableblity in Non monospace fonts 
+	 * and NotoSanMono where the max advance is different
+	 * as some glyphs in that font have different widths and thus
+	 * advances based on this idea
+	 * https://codeberg.org/dnkl/foot/commit/bb948d03e199870da6b35ba6f88ea88be12cfe21
+	 */
+	FT_Load_Char(face, 'M', FT_LOAD_DEFAULT);
+	font->advance.x = face->glyph->advance.x >> 6;
+	font->ascent = face->size->metrics.ascender >> 6;
+	font->descent = face->size->metrics.descender >> 6;
+	return 0;
+}
+
 void magma_font_deinit(magma_font_t *font) {
 
-	FT_Done_Face(font->face);
+	/*shared faces are referenced once per style*/
+	for(int style = 0; style < MAGMA_FONT_STYLES; style++) {
+		FT_Done_Face(font->faces[style]);
+	}
 
 	FcConfigDestroy(font->font_config);
 
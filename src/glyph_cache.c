@@ -0,0 +1,379 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_GLYPH_H
+#include FT_BITMAP_H
+#include FT_OUTLINE_H
+
+#include <magma/glyph_cache.h>
+#include <magma/logger/log.h>
+#include <magma/unicode.h>
+
+/* Glyph cache.
+ *
+ * A miss renders the character with FreeType into an FT_Glyph
+ * of its own, so nothing depends on the face's glyph slot, and
+ * copies the bitmap into the arena. A cluster's base and the
+ * combining marks the font has are merged into one bitmap, there
+ * is no shaping. The cache only grows, when the arena gets too
+ * big everything is dropped and rendered again as it is drawn.
+ */
+
+#define GLYPH_CACHE_INITIAL 256
+#define GLYPH_ARENA_INITIAL (64 * 1024)
+/*most code points of a cluster merged into its bitmap*/
+#define GLYPH_PARTS 8
+
+static inline uint32_t glyph_hash(utf32_t unicode, unsigned style) {
+	uint32_t h = (unicode ^ style << 29) * 0x9e3779b1;
+	return h ^ (h >> 15);
+}
+
+/*slot holding the glyph, or the empty slot it would go in*/
+static uint32_t glyph_cache_slot(const magma_glyph_cache_t *cache, utf32_t unicode, unsigned style) {
+	uint32_t slot = glyph_hash(unicode, style) & cache->mask;
+	const magma_glyph_entry_t *entry;
+
+	for(;;) {
+		entry = &cache->entries[slot];
+		if(!entry->unicode || (entry->unicode == unicode && entry->style == style)) {
+			return slot;
+		}
+		slot = (slot + 1) & cache->mask;
+	}
+}
+
+static int glyph_cache_rehash(magma_glyph_cache_t *cache, uint32_t size) {
+	magma_glyph_entry_t *old = cache->entries, *entries;
+	uint32_t old_size = old ? cache->mask + 1 : 0;
+
+	entries = calloc(size, sizeof(magma_glyph_entry_t));
+	if(!entries) {
+		magma_log_error("Failed to allocate glyph cache of %u\n", size);
+		return -1;
+	}
+
+	cache->entries = entries;
+	cache->mask = size - 1;
+
+	for(uint32_t i = 0; i < old_size; i++) {
+		if(old[i].unicode) {
+			cache->entries[glyph_cache_slot(cache, old[i].unicode, old[i].style)] = old[i];
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
+/*room for size more bytes of bitmap, flushes the cache when it is full*/
+static uint8_t *glyph_cache_alloc(magma_glyph_cache_t *cache, size_t size, uint32_t *offset) {
+	size_t arena_size = cache->arena_size;
+	uint8_t *arena;
+
+	if(cache->arena_used + size > MAGMA_GLYPH_CACHE_MAX) {
+		if(size > MAGMA_GLYPH_CACHE_MAX) {
+			return NULL;
+		}
+
+		magma_log_debug("Flushing glyph cache of %u glyphs\n", cache->count);
+		magma_glyph_cache_clear(cache);
+	}
+
+	if(cache->arena_used + size > arena_size) {
+		while(cache->arena_used + size > arena_size) {
+			arena_size *= 2;
+		}
+
+		arena = realloc(cache->arena, arena_size);
+		if(!arena) {
+			magma_log_error("Failed to grow glyph arena to %zu\n", arena_size);
+			return NULL;
+		}
+		cache->arena = arena;
+		cache->arena_size = arena_size;
+	}
+
+	*offset = cache->arena_used;
+	cache->arena_used += size;
+	return &cache->arena[*offset];
+}
+
+/*coverage of a pixel, any non zero value for a mono bitmap*/
+static inline uint8_t glyph_pixel(const FT_Bitmap *bitmap, int x, int y) {
+	const uint8_t *row = &bitmap->buffer[y * bitmap->pitch];
+
+	if(bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+		return row[x >> 3] & (0x80 >> (x & 7));
+	}
+	return row[x];
+}
+
+/* strikes with 2 or 4 bits per pixel, and FT_Bitmap_Embolden
+ * on them, give 8 bit pixels with only as many levels as before.
+ * Make them a byte of coverage from 0 to 255 like rendered ones
+ */
+static void glyph_stretch_grays(FT_Library lib, FT_Bitmap *bitmap) {
+	FT_Bitmap converted;
+	uint8_t *row;
+
+	if(bitmap->pixel_mode == FT_PIXEL_MODE_GRAY2 || bitmap->pixel_mode == FT_PIXEL_MODE_GRAY4) {
+		FT_Bitmap_Init(&converted);
+		if(FT_Bitmap_Convert(lib, bitmap, &converted, 1)) {
+			return;
+		}
+		FT_Bitmap_Done(lib, bitmap);
+		*bitmap = converted;
+	}
+
+	if(bitmap->pixel_mode != FT_PIXEL_MODE_GRAY || bitmap->num_grays < 2 || bitmap->num_grays == 256) {
+		return;
+	}
+
+	for(unsigned y = 0; y < bitmap->rows; y++) {
+		row = &bitmap->buffer[y * bitmap->pitch];
+		for(unsigned x = 0; x < bitmap->width; x++) {
+			row[x] = row[x] * 255 / (bitmap->num_grays - 1);
+		}
+	}
+	bitmap->num_grays = 256;
+}
+
+/*add the coverage of a rendered glyph to the bitmap at x, y*/
+static void glyph_merge(const magma_glyph_t *glyph, uint8_t *bitmap, const FT_BitmapGlyph src, int x, int y) {
+	uint8_t *row, value;
+
+	for(int yp = 0; yp < (int)src->bitmap.rows; yp++) {
+		row = &bitmap[(y + yp) * glyph->pitch];
+		for(int xp = 0; xp < (int)src->bitmap.width; xp++) {
+			value = glyph_pixel(&src->bitmap, xp, yp);
+			if(!value) {
+				continue;
+			}
+
+			if(glyph->format == MAGMA_GLYPH_FORMAT_MONO) {
+				row[(x + xp) >> 3] |= 0x80 >> ((x + xp) & 7);
+			} else if(src->bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+				row[x + xp] = 0xff;
+			} else if(value > row[x + xp]) {
+				row[x + xp] = value;
+			}
+		}
+	}
+}
+
+/*the code points of a cell that end up in its bitmap*/
+static int glyph_code_points(const magma_vt_t *vt, utf32_t unicode, utf32_t drawn[GLYPH_PARTS]) {
+	const utf32_t *cps;
+	int len, n = 0;
+
+	cps = magma_vt_cluster(vt, &(glyph_t){ .unicode = unicode }, &len);
+	for(int i = 0; i < len && n < GLYPH_PARTS; i++) {
+		/*without shaping only marks drawn on top of the base make sense*/
+		if(i > 0 && (magma_wcwidth(cps[i]) != 0 || magma_unicode_gcb(cps[i]) != MAGMA_GCB_EXTEND)) {
+			continue;
+		}
+		drawn[n++] = cps[i];
+	}
+
+	return n;
+}
+
+static int glyph_render(magma_glyph_cache_t *cache, const magma_vt_t *vt, utf32_t unicode,
+		unsigned style, magma_glyph_t *glyph) {
+	/*the slant FreeType gives synthetic obliques*/
+	FT_Matrix oblique = { .xx = 0x10000, .xy = 0x0366a, .yx = 0, .yy = 0x10000 };
+	magma_font_t *font = cache->font;
+	FT_Glyph parts[GLYPH_PARTS];
+	utf32_t drawn[GLYPH_PARTS];
+	FT_BitmapGlyph bitmap;
+	FT_Face face;
+	FT_UInt index;
+	uint8_t synthetic;
+	int n, n_parts = 0, left = 0, top = 0, right = 0, bottom = 0, ret = -1;
+	uint8_t *pixels;
+
+	n = glyph_code_points(vt, unicode, drawn);
+	for(int i = 0; i < n; i++) {
+		face = font->faces[style];
+		synthetic = font->synthetic[style];
+		index = FT_Get_Char_Index(face, drawn[i]);
+
+		/*what the style's face lacks is made up from the regular one*/
+		if(index == 0 && face != font->faces[0] && FT_Get_Char_Index(font->faces[0], drawn[i])) {
+			face = font->faces[0];
+			synthetic = style;
+			index = FT_Get_Char_Index(face, drawn[i]);
+		}
+
+		/*a missing mark is left out rather than drawn as a box*/
+		if(i > 0 && index == 0) {
+			continue;
+		}
+
+		if(FT_Load_Glyph(face, index, FT_LOAD_DEFAULT) ||
+				FT_Get_Glyph(face->glyph, &parts[n_parts])) {
+			continue;
+		}
+
+		/*outlines are slanted and thickened before they're rasterized*/
+		if(parts[n_parts]->format == FT_GLYPH_FORMAT_OUTLINE) {
+			if(synthetic & MAGMA_FONT_ITALIC) {
+				FT_Glyph_Transform(parts[n_parts], &oblique, NULL);
+			}
+			if(synthetic & MAGMA_FONT_BOLD) {
+				FT_Outline_Embolden(&((FT_OutlineGlyph)parts[n_parts])->outline, 1 << 6);
+				synthetic &= ~MAGMA_FONT_BOLD;
+			}
+		}
+
+		if(FT_Glyph_To_Bitmap(&parts[n_parts], cache->render_mode, NULL, 1)) {
+			FT_Done_Glyph(parts[n_parts]);
+			continue;
+		}
+
+		bitmap = (FT_BitmapGlyph)parts[n_parts];
+		if(synthetic & MAGMA_FONT_BOLD) {
+			FT_Bitmap_Embolden(font->ft_lib, &bitmap->bitmap, 1 << 6, 1 << 6);
+		}
+		glyph_stretch_grays(font->ft_lib, &bitmap->bitmap);
+
+		if(n_parts == 0 || bitmap->left < left) {
+			left = bitmap->left;
+		}
+		if(n_parts == 0 || bitmap->top > top) {
+			top = bitmap->top;
+		}
+		if(n_parts == 0 || bitmap->left + (int)bitmap->bitmap.width > right) {
+			right = bitmap->left + bitmap->bitmap.width;
+		}
+		if(n_parts == 0 || bitmap->top - (int)bitmap->bitmap.rows < bottom) {
+			bottom = bitmap->top - bitmap->bitmap.rows;
+		}
+		n_parts++;
+	}
+
+	if(n_parts == 0) {
+		return -1;
+	}
+
+	bitmap = (FT_BitmapGlyph)parts[0];
+	*glyph = (magma_glyph_t){
+		.left = left,
+		.top = top,
+		.width = right - left,
+		.rows = top - bottom,
+		.format = bitmap->bitmap.pixel_mode == FT_PIXEL_MODE_MONO ?
+			MAGMA_GLYPH_FORMAT_MONO : MAGMA_GLYPH_FORMAT_GRAY,
+		.cached = true,
+	};
+	glyph->pitch = glyph->format == MAGMA_GLYPH_FORMAT_MONO ? (glyph->width + 7) / 8 : glyph->width;
+
+	pixels = glyph_cache_alloc(cache, (size_t)glyph->pitch * glyph->rows, &glyph->offset);
+	if(pixels) {
+		memset(pixels, 0, (size_t)glyph->pitch * glyph->rows);
+		for(int i = 0; i < n_parts; i++) {
+			bitmap = (FT_BitmapGlyph)parts[i];
+			glyph_merge(glyph, pixels, bitmap, bitmap->left - left, top - bitmap->top);
+		}
+		ret = 0;
+	}
+
+	for(int i = 0; i < n_parts; i++) {
+		FT_Done_Glyph(parts[i]);
+	}
+
+	return ret;
+}
+
+magma_glyph_cache_t *magma_glyph_cache_init(magma_font_t *font) {
+	magma_glyph_cache_t *cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if(!cache) {
+		magma_log_error("Failed to allocate glyph cache\n");
+		goto err_cache;
+	}
+
+	cache->arena = malloc(GLYPH_ARENA_INITIAL);
+	if(!cache->arena) {
+		magma_log_error("Failed to allocate glyph arena\n");
+		goto err_arena;
+	}
+	cache->arena_size = GLYPH_ARENA_INITIAL;
+
+	if(glyph_cache_rehash(cache, GLYPH_CACHE_INITIAL) < 0) {
+		goto err_entries;
+	}
+
+	cache->font = font;
+	cache->render_mode = FT_RENDER_MODE_NORMAL;
+	return cache;
+
+err_entries:
+	free(cache->arena);
+err_arena:
+	free(cache);
+err_cache:
+	return NULL;
+}
+
+void magma_glyph_cache_deinit(magma_glyph_cache_t *cache) {
+	free(cache->entries);
+	free(cache->arena);
+	free(cache);
+}
+
+void magma_glyph_cache_clear(magma_glyph_cache_t *cache) {
+	memset(cache->entries, 0, (cache->mask + 1) * sizeof(magma_glyph_entry_t));
+	memset(cache->ascii, 0, sizeof(cache->ascii));
+	cache->count = 0;
+	cache->arena_used = 0;
+}
+
+const magma_glyph_t *magma_glyph_cache_find(magma_glyph_cache_t *cache, const magma_vt_t *vt,
+		utf32_t unicode, unsigned style) {
+	uint32_t generation = unicode & MAGMA_GLYPH_CLUSTER ? vt->clusters.generation : 0;
+	magma_glyph_entry_t *entry;
+	magma_glyph_t glyph;
+
+	if(unicode >= 128) {
+		entry = &cache->entries[glyph_cache_slot(cache, unicode, style)];
+		if(entry->unicode && entry->generation == generation) {
+			return &entry->glyph;
+		}
+	}
+
+	if(glyph_render(cache, vt, unicode, style, &glyph) < 0) {
+		return NULL;
+	}
+
+	if(unicode < 128) {
+		cache->ascii[style][unicode] = glyph;
+		return &cache->ascii[style][unicode];
+	}
+
+	/*a stale cluster is replaced where it is*/
+	entry = &cache->entries[glyph_cache_slot(cache, unicode, style)];
+	if(!entry->unicode) {
+		if((cache->count + 1) * 2 > cache->mask + 1) {
+			if(glyph_cache_rehash(cache, (cache->mask + 1) * 2) < 0) {
+				return NULL;
+			}
+			entry = &cache->entries[glyph_cache_slot(cache, unicode, style)];
+		}
+		cache->count++;
+	}
+
+	*entry = (magma_glyph_entry_t){
+		.unicode = unicode,
+		.generation = generation,
+		.style = style,
+		.glyph = glyph,
+	};
+	return &entry->glyph;
+}
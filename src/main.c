@@ -19,7 +19,6 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_OUTLINE_H
-#include FT_BITMAP_H
 #include <fontconfig/fontconfig.h>
 
 #include <magma/logger/log.h>
@@ -27,6 +26,8 @@
 #include <magma/renderer/vk.h>
 #include <magma/vt.h>
 #include <magma/font.h>
+#include <magma/glyph_cache.h>
+#include <magma/blit.h>
 
 #include <xkbcommon/xkbcommon.h>
 
@@ -43,6 +44,18 @@ typedef struct magma_ctx {
 	magma_backend_t *backend;
 	magma_vk_renderer_t *renderer;
 	magma_font_t *font;
+	magma_glyph_cache_t *glyphs;
+
+	/*a scrollback row being drawn is copied in here*/
+	glyph_t *view_row;
+
+	/* what is on screen, kept between frames so only the
+	 * cells the vt damaged have to be drawn again
+	 */
+	magma_buf_t frame;
+	bool frame_reset;
+	int cursor_x, cursor_y;
+	bool cursor_shown;
 	
 	uint32_t width, height, x, y;
 
@@ -53,75 +66,207 @@ typedef struct magma_ctx {
 	bool is_running;
 } magma_ctx_t;
 
-int glyph_check_bit(const FT_GlyphSlot glyph, const int x, const int y)
-{
-    int pitch = glyph->bitmap.pitch;
-    unsigned char *row = &glyph->bitmap.buffer[pitch * y];
-    char cValue = row[x >> 3];
+static void fill_rect(magma_buf_t *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color) {
+	uint32_t *row;
+
+	for(uint32_t yp = y; yp < y + h && yp < buf->height; yp++) {
+		row = &((uint32_t *)buf->buffer)[yp * (buf->pitch / 4)];
+		for(uint32_t xp = x; xp < x + w && xp < buf->width; xp++) {
+			row[xp] = color;
+		}
+	}
+}
 
-    return (cValue & (128 >> (x & 7))) != 0;
+/*halve each channel, keeps alpha*/
+static inline uint32_t color_dim(uint32_t color) {
+	return (color & 0xff000000) | ((color >> 1) & 0x7f7f7f);
 }
 
 void echo_char(magma_ctx_t *ctx, glyph_t g, int x, int y, magma_buf_t *buf) {
-	FT_Bitmap *bitmap;
-	FT_GlyphSlot glyph;
-	FT_UInt glyphindex;
+	const magma_glyph_t *glyph;
 	utf32_t ch = g.unicode;
-	uint32_t yp, xp, xoff, ypos, xpos, yoff;
+	uint32_t xoff, yoff, fg, bg, tmp;
+	uint32_t cell_y = y * ctx->font->height;
+	uint32_t width = ctx->font->advance.x;
+	const magma_style_t *style = magma_vt_style(ctx->vt, g.style);
 
-	if(ch == '\r') {
+	/*the wide character before it covers both cells*/
+	if(g.flags & MAGMA_GLYPH_WIDE_TAIL) {
 		return;
 	}
+	if(g.flags & MAGMA_GLYPH_WIDE) {
+		width *= 2;
+	}
 
 	xoff = x * ctx->font->advance.x;
-	yoff = (y * ctx->font->height) + ctx->font->ascent;
+	yoff = cell_y + ctx->font->ascent;
 
-	glyphindex = FT_Get_Char_Index(ctx->font->face, ch);
+	fg = magma_vt_color_resolve(style->fg, MAGMA_VT_DEFAULT_FG);
+	bg = magma_vt_color_resolve(style->bg, MAGMA_VT_DEFAULT_BG);
+	if(style->attributes & MAGMA_ATTR_DIM) {
+		fg = color_dim(fg);
+	}
+	if(style->attributes & MAGMA_ATTR_INVERSE) {
+		tmp = fg;
+		fg = bg | 0xff000000;
+		bg = tmp;
+	}
 
-	FT_Load_Glyph(ctx->font->face, glyphindex, FT_LOAD_DEFAULT);
-	FT_Render_Glyph(ctx->font->face->glyph, FT_RENDER_MODE_MONO);
-	
-	bitmap = &ctx->font->face->glyph->bitmap;
-	glyph = ctx->font->face->glyph;
-	if(ctx->vt->lines[y][x].attributes == 1) {
-		FT_Bitmap_Embolden(ctx->font->ft_lib, bitmap, 1 << 6, 1 << 6);
-	}
-
-	for(yp = 0; yp < bitmap->rows; yp++) {
-		for(xp = 0; xp < bitmap->width; xp++) {
-			if(glyph_check_bit(glyph, xp, yp)) {
-				ypos = yp + yoff - glyph->bitmap_top; 
-				xpos = xp + (xoff + glyph->bitmap_left);
-				((uint32_t *)buf->buffer)[ypos * (buf->pitch / 4) + xpos] = g.fg;
-			}
+	if(style->bg != MAGMA_COLOR_DEFAULT || style->attributes & MAGMA_ATTR_INVERSE) {
+		fill_rect(buf, xoff, cell_y, width, ctx->font->height, bg);
+	}
+
+	if(ch == 0 || style->attributes & MAGMA_ATTR_INVISIBLE) {
+		return;
+	}
+
+	if(style->attributes & MAGMA_ATTR_UNDERLINE) {
+		fill_rect(buf, xoff, yoff + 1, width, 1, fg);
+		if(((style->attributes & MAGMA_ATTR_UNDERLINE) >> MAGMA_ATTR_UNDERLINE_SHIFT) == MAGMA_UNDERLINE_DOUBLE) {
+			fill_rect(buf, xoff, yoff + 3, width, 1, fg);
 		}
 	}
+	if(style->attributes & MAGMA_ATTR_STRIKE) {
+		fill_rect(buf, xoff, yoff - ctx->font->ascent / 3, width, 1, fg);
+	}
+	if(style->attributes & MAGMA_ATTR_OVERLINE) {
+		fill_rect(buf, xoff, cell_y, width, 1, fg);
+	}
+
+	glyph = magma_glyph_cache_get(ctx->glyphs, ctx->vt, ch,
+			(style->attributes & MAGMA_ATTR_BOLD ? MAGMA_FONT_BOLD : 0) |
+			(style->attributes & MAGMA_ATTR_ITALIC ? MAGMA_FONT_ITALIC : 0));
+	if(glyph) {
+		magma_blit_glyph(buf, glyph, magma_glyph_bitmap(ctx->glyphs, glyph), xoff, yoff, fg);
+	}
 }
 
-void draw_cb(magma_backend_t *backend, uint32_t height, uint32_t width, void *data) {
-	if(height == 0 || width == 0) return;
-	magma_ctx_t *ctx = data;
+/*clear columns x0 to x1 of screen row y and draw them again*/
+static void draw_cells(magma_ctx_t *ctx, int y, int x0, int x1) {
+	int used;
+	line_t line = magma_vt_view_line(ctx->vt, y, ctx->view_row, &used);
+
+	/*both halves of a wide character are drawn together*/
+	if(x0 > 0 && line[x0].flags & MAGMA_GLYPH_WIDE_TAIL) {
+		x0--;
+	}
+	if(x1 < ctx->vt->cols && line[x1 - 1].flags & MAGMA_GLYPH_WIDE) {
+		x1++;
+	}
 
-	struct magma_buf *vk = magma_vk_draw(ctx->renderer);
+	fill_rect(&ctx->frame, x0 * ctx->font->advance.x, y * ctx->font->height,
+			(x1 - x0) * ctx->font->advance.x, ctx->font->height, MAGMA_VT_DEFAULT_BG);
 
-	for(int y = 0; y <= ctx->vt->buf_y; y++) {
-		for(int x = 0; x < ctx->vt->cols; ) {
-			if(ctx->vt->lines[y][x].unicode == '\n' || (y == ctx->vt->buf_y && x == ctx->vt->buf_x)) {
-				break;
-			}
-			if(ctx->vt->lines[y][x].unicode == 0x09) {
-				x = ((x) | (8 - 1)) + 1;
-				continue;
+	/*past used the background is all there is to draw*/
+	if(x1 > used) {
+		x1 = used;
+	}
+	for(int x = x0; x < x1; x++) {
+		echo_char(ctx, line[x], x, y, &ctx->frame);
+	}
+}
+
+/*slide the pixels of a row move the same way the vt moved the rows*/
+static void frame_move(magma_ctx_t *ctx, const magma_vt_move_t *move) {
+	uint32_t row_size = ctx->frame.pitch * ctx->font->height;
+	uint8_t *pixels = ctx->frame.buffer;
+	int height = move->bottom - move->top + 1;
+	int n = move->count < 0 ? -move->count : move->count;
+
+	/*the moved in rows are damaged and get drawn anyway*/
+	if(n < height) {
+		if(move->count > 0) {
+			memmove(&pixels[move->top * row_size], &pixels[(move->top + n) * row_size],
+					(height - n) * row_size);
+		} else {
+			memmove(&pixels[(move->top + n) * row_size], &pixels[move->top * row_size],
+					(height - n) * row_size);
+		}
+	}
+
+	/*the cursor went with its row*/
+	if(ctx->cursor_shown && ctx->cursor_y >= move->top && ctx->cursor_y <= move->bottom) {
+		ctx->cursor_y -= move->count;
+		if(ctx->cursor_y < move->top || ctx->cursor_y > move->bottom) {
+			ctx->cursor_shown = false;
+		}
+	}
+}
+
+/**
+ *	@brief bring ctx->frame up to date with the vt
+ *
+ *	@retval true the frame changed and has to be presented
+ *	@retval false nothing changed since the last call
+ */
+static bool render_frame(magma_ctx_t *ctx) {
+	magma_vt_t *vt = ctx->vt;
+	const magma_vt_move_t *moves;
+	int n_moves, x0, x1, cursor_y;
+	bool full, cursor_shown;
+
+	if(!ctx->frame.buffer) {
+		return false;
+	}
+
+	/*the cursor moves down with the screen while looking at history*/
+	cursor_y = vt->buf_y + vt->view;
+	cursor_shown = cursor_y < vt->rows;
+
+	n_moves = magma_vt_take_moves(vt, &moves);
+	full = n_moves < 0 || ctx->frame_reset;
+
+	if(!full && !vt->dirty && cursor_shown == ctx->cursor_shown &&
+			(!cursor_shown || (vt->buf_x == ctx->cursor_x && cursor_y == ctx->cursor_y))) {
+		return false;
+	}
+
+	if(full) {
+		fill_rect(&ctx->frame, 0, 0, ctx->frame.width, ctx->frame.height, MAGMA_VT_DEFAULT_BG);
+		for(int y = 0; y < vt->rows; y++) {
+			magma_vt_take_damage(vt, y, &x0, &x1);
+			draw_cells(ctx, y, 0, vt->cols);
+		}
+	} else {
+		for(int i = 0; i < n_moves; i++) {
+			frame_move(ctx, &moves[i]);
+		}
+
+		/*draw over the old cursor*/
+		if(ctx->cursor_shown && ctx->cursor_y < vt->rows && ctx->cursor_x < vt->cols) {
+			draw_cells(ctx, ctx->cursor_y, ctx->cursor_x, ctx->cursor_x + 1);
+		}
+
+		/*rows scrolled back below the window stay damaged until they're seen*/
+		for(int y = vt->view; y < vt->rows; y++) {
+			if(magma_vt_take_damage(vt, y - vt->view, &x0, &x1)) {
+				draw_cells(ctx, y, x0, x1);
 			}
-			echo_char(ctx, ctx->vt->lines[y][x], x, y, vk);
-			x++;
 		}
 	}
+	vt->dirty = false;
 
-	glyph_t cursor = { .unicode = '_', .fg = 0xf8f8f2, .bg = 0, .attributes = 0};
-	echo_char(ctx, cursor, ctx->vt->buf_x, ctx->vt->buf_y, vk);
+	if(cursor_shown) {
+		glyph_t cursor = { .unicode = '_', .style = 0 };
+		echo_char(ctx, cursor, vt->buf_x, cursor_y, &ctx->frame);
+	}
+	ctx->cursor_x = vt->buf_x;
+	ctx->cursor_y = cursor_y;
+	ctx->cursor_shown = cursor_shown;
+	ctx->frame_reset = false;
 
-	magma_backend_put_buffer(backend, vk);
+	return true;
+}
+
+void draw_cb(magma_backend_t *backend, uint32_t height, uint32_t width, void *data) {
+	if(height == 0 || width == 0) return;
+	magma_ctx_t *ctx = data;
+
+	/*exposed, the window needs the whole frame even if nothing changed*/
+	render_frame(ctx);
+	if(ctx->frame.buffer) {
+		magma_backend_put_buffer(backend, &ctx->frame);
+	}
 }
 
 void keymap_cb(magma_backend_t *backend, void *data) {
@@ -187,6 +332,16 @@ void magma_key_press(magma_ctx_t *ctx, int key, xkb_keysym_t keysym) {
 	int len;
 	char utf8_buf[5];
 
+	/*shift+page up/down scroll through history by half a screen*/
+	if((keysym == XKB_KEY_Page_Up || keysym == XKB_KEY_Page_Down) &&
+			xkb_state_mod_name_is_active(ctx->state, XKB_MOD_NAME_SHIFT, XKB_STATE_MODS_EFFECTIVE) > 0) {
+		magma_vt_scroll_view(ctx->vt, (keysym == XKB_KEY_Page_Up ? 1 : -1) * (ctx->vt->rows / 2));
+		return;
+	}
+
+	/*typing jumps back to the live screen*/
+	magma_vt_scroll_view(ctx->vt, -(long)ctx->vt->view);
+
 	if(keysym == XKB_KEY_BackSpace) {
 		write(ctx->vt->master, "\177", 1);
 		return;
@@ -223,46 +378,52 @@ void resize_cb(magma_backend_t *backend, uint32_t height, uint32_t width, void *
 	UNUSED(backend);
 	magma_ctx_t *ctx = data;
 	struct winsize ws;
+	glyph_t *view_row;
+	void *pixels;
 
 	ws.ws_xpixel = width;
 	ws.ws_ypixel = height;
 	ws.ws_col = width / (ctx->font->advance.x);
 	ws.ws_row = height / (ctx->font->height);
 
-	ctx->vt->lines = realloc(ctx->vt->lines, sizeof(void*) * ws.ws_row);
-
+	/*the grid needs at least one cell even while minimized*/
+	if(ws.ws_col == 0) ws.ws_col = 1;
+	if(ws.ws_row == 0) ws.ws_row = 1;
 
-	if(ctx->vt->rows < ws.ws_row) {
-		/*We grew*/
-		for(int i = 0; i < ctx->vt->rows; i++) {
-			ctx->vt->lines[i] = realloc(ctx->vt->lines[i], ws.ws_col * sizeof(glyph_t));
-		}
+	view_row = realloc(ctx->view_row, ws.ws_col * sizeof(glyph_t));
+	if(!view_row) {
+		magma_log_error("Failed to allocate view row\n");
+		return;
+	}
+	ctx->view_row = view_row;
 
-		for(int i = ctx->vt->rows; i < ws.ws_row; i++) {
-			ctx->vt->lines[i] = calloc(sizeof(glyph_t), ws.ws_col);
-		}
-	} else {
-		/*we shrunk*/
-		for(int i = 0; i < ws.ws_row; i++) {
-			ctx->vt->lines[i] = realloc(ctx->vt->lines[i], sizeof(glyph_t) * ws.ws_col);
-			ctx->vt->lines[i][ws.ws_col - 1].unicode = '\n';
-		}
+	pixels = realloc(ctx->frame.buffer, (size_t)width * height * 4);
+	if(!pixels) {
+		magma_log_error("Failed to allocate %ux%u frame\n", width, height);
+		return;
+	}
+	ctx->frame.buffer = pixels;
+	ctx->frame.width = width;
+	ctx->frame.height = height;
+	ctx->frame.pitch = width * 4;
+	ctx->frame.size = (size_t)width * height * 4;
+	ctx->frame.bpp = 32;
+	ctx->frame_reset = true;
+
+	if(magma_vt_resize(ctx->vt, ws.ws_row, ws.ws_col) < 0) {
+		return;
 	}
 
-	ctx->vt->rows = ws.ws_row;
-	ctx->vt->cols = ws.ws_col;
 	ctx->width = width;
 	ctx->height = height;
-	if(ctx->vt->buf_y >= ws.ws_row) {
-		ctx->vt->buf_y = ws.ws_row - 1;
-		ctx->vt->buf_x = 0;
-	}
-	
+
 	if(ioctl(ctx->vt->master, TIOCSWINSZ, &ws)) {
 		printf("Failed to update term size\n");
 	}
 
-	magma_vk_handle_resize(ctx->renderer, width, height);
+	if(ctx->renderer) {
+		magma_vk_handle_resize(ctx->renderer, width, height);
+	}
 }
 
 void on_close(magma_backend_t *backend, void *data) {
@@ -278,16 +439,24 @@ int main(int argc, char **argv) {
 	int slave;
 	magma_ctx_t ctx = { 0 };
 	struct pollfd pfd;
+	char *pty_thread, *scrollback, *antialias;
 	magma_log_set_level(MAGMA_DEBUG);
 
-	ctx.vt = calloc(1, sizeof(*ctx.vt));
-	ctx.vt->lines = calloc(sizeof(void *), 25);
-	for(int i = 0; i < 25; i++) {
-		ctx.vt->lines[i] = calloc(sizeof(glyph_t), 80);
+	ctx.vt = magma_vt_init(25, 80);
+	if(!ctx.vt) {
+		return -1;
+	}
+
+	ctx.view_row = calloc(ctx.vt->cols, sizeof(glyph_t));
+	if(!ctx.view_row) {
+		return -1;
+	}
+
+	/*MAGMA_SCROLLBACK is the history size in MiB*/
+	scrollback = getenv("MAGMA_SCROLLBACK");
+	if(scrollback) {
+		magma_vt_set_scrollback(ctx.vt, strtoul(scrollback, NULL, 10) * 1024 * 1024);
 	}
-	ctx.vt->cols = 80;
-	ctx.vt->rows = 25;
-	ctx.vt->fg = 0xf8f8f2;	
 
 	if(magma_get_pty(&ctx.vt->master, &slave) < 0) {
 		return -1;
@@ -299,20 +468,20 @@ int main(int argc, char **argv) {
 
 	FcInit();
 	ctx.font = magma_font_init("monospace");
-	FT_Set_Pixel_Sizes(ctx.font->face, 18, 18);
-	ctx.font->height = ctx.font->face->size->metrics.height >> 6;
-	
-	/* Get the size of the M character to use as the advance width 
-	 * as it will improve readableblity in Non monospace fonts 
-	 * and NotoSanMono where the max advance is different
-	 * as some glyphs in that font have different widths and thus
-	 * advances based on this idea
-	 * https://codeberg.org/dnkl/foot/commit/bb948d03e199870da6b35ba6f88ea88be12cfe21
-	 */
-	FT_Load_Char(ctx.font->face, 'M', FT_LOAD_DEFAULT);
-	ctx.font->advance.x = ctx.font->face->glyph->advance.x >> 6;
-	ctx.font->ascent = ctx.font->face->size->metrics.ascender >> 6;
-	ctx.font->descent = ctx.font->face->size->metrics.descender >> 6;
+	if(!ctx.font || magma_font_set_size(ctx.font, 18) < 0) {
+		return -1;
+	}
+
+	ctx.glyphs = magma_glyph_cache_init(ctx.font);
+	if(!ctx.glyphs) {
+		return -1;
+	}
+
+	/*MAGMA_ANTIALIAS=0 draws text in 1 bit like it used to*/
+	antialias = getenv("MAGMA_ANTIALIAS");
+	if(antialias && !atoi(antialias)) {
+		ctx.glyphs->render_mode = FT_RENDER_MODE_MONO;
+	}
 	
 	if(magma_fork_pty(ctx.vt->master, &slave) < 0) {
 		magma_log_info("Failed to fork\n");
@@ -333,40 +502,54 @@ int main(int argc, char **argv) {
 	magma_backend_set_on_keymap(ctx.backend, keymap_cb, &ctx);
 	magma_backend_start(ctx.backend);
 
-	pfd.fd = ctx.vt->master;
+	/* read the pty on its own thread when there is a spare
+	 * core for it, MAGMA_PTY_THREAD=0/1 overrides the choice
+	 */
+	pty_thread = getenv("MAGMA_PTY_THREAD");
+	if(pty_thread ? atoi(pty_thread) : sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+		if(magma_vt_reader_start(ctx.vt) < 0) {
+			magma_log_warn("Failed to start pty reader thread, reading on the main thread\n");
+		}
+	}
+
+	pfd.fd = magma_vt_get_fd(ctx.vt);
 	pfd.events = POLLIN;
 	while(ctx.is_running) {
 		magma_backend_dispatch_events(ctx.backend);
 	
-		while(poll(&pfd, 1, 10)) {
-			if(pfd.revents & POLLERR || pfd.revents & POLLHUP) {
+		if(poll(&pfd, 1, 10) > 0) {
+			/* drain before checking for hangup so the 
+			 * childs last output still makes it on screen
+			 */
+			if(vt_read_input(ctx.vt) < 0 || pfd.revents & POLLERR) {
 				printf("Child is process has closed\n");
 				ctx.is_running = 0;
-				break;
 			}
-
-			vt_read_input(ctx.vt);
 		}
-		draw_cb(ctx.backend, ctx.height, ctx.width, &ctx);
+		/* wait for the end of a synchronized update to avoid
+		 * tearing, an idle terminal doesn't present anything
+		 */
+		if(!magma_vt_frame_held(ctx.vt) && render_frame(&ctx)) {
+			magma_backend_put_buffer(ctx.backend, &ctx.frame);
+		}
 
 	}
 
-	magma_vk_renderer_deinit(ctx.renderer);
+	if(ctx.renderer) {
+		magma_vk_renderer_deinit(ctx.renderer);
+	}
 	magma_backend_dispatch_events(ctx.backend);
 	magma_backend_deinit(ctx.backend);
+	magma_glyph_cache_deinit(ctx.glyphs);
 	magma_font_deinit(ctx.font);
 
 	xkb_state_unref(ctx.state);
 	xkb_keymap_unref(ctx.keymap);
 	xkb_context_unref(ctx.context);
 	
-	for(int32_t y = 0; y < ctx.vt->rows; y++) {
-		free(ctx.vt->lines[y]);
-	}
-
-	free(ctx.vt->lines);
-
-	free(ctx.vt);
+	magma_vt_deinit(ctx.vt);
+	free(ctx.view_row);
+	free(ctx.frame.buffer);
 
 	FcFini();
 	return 0;
@@ -0,0 +1,641 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+#include <magma/private/renderer/vk.h>
+#include <magma/renderer/vk.h>
+#include <magma/logger/log.h>
+
+/* Glyph atlas.
+ *
+ * Glyph coverage is packed into R8 pages with a skyline, the
+ * packed area of a page is described by the height of its top
+ * edge across the width. A glyph goes where that edge is lowest
+ * and it fits. Glyphs can't be taken out of a skyline one by one
+ * so eviction works on whole pages, the page last looked up the
+ * longest ago is emptied and packed again.
+ *
+ * Inserts only copy the bitmap to a mapped staging buffer, all
+ * of them are copied to their pages in one submit on flush.
+ */
+
+#define ATLAS_ENTRIES_INITIAL 512
+/*gap left around glyphs so sampling one never reads its neighbour*/
+#define ATLAS_PADDING 1
+
+uint32_t getMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags properties);
+
+static inline uint32_t atlas_hash(uint64_t key) {
+	key *= 0x9e3779b97f4a7c15ull;
+	return key >> 32;
+}
+
+/*slot holding the key, or the empty slot it would go in*/
+static uint32_t atlas_slot(const magma_vk_atlas_t *atlas, uint64_t key) {
+	uint32_t slot = atlas_hash(key) & atlas->mask;
+
+	while(atlas->entries[slot].key && atlas->entries[slot].key != key) {
+		slot = (slot + 1) & atlas->mask;
+	}
+	return slot;
+}
+
+/*rebuild the table at size, leaving out the glyphs on page drop*/
+static int atlas_rehash(magma_vk_atlas_t *atlas, uint32_t size, int drop) {
+	magma_vk_atlas_glyph_t *old = atlas->entries, *entries;
+	uint32_t old_size = old ? atlas->mask + 1 : 0;
+
+	entries = calloc(size, sizeof(magma_vk_atlas_glyph_t));
+	if(!entries) {
+		magma_log_error("Failed to allocate glyph atlas table of %u\n", size);
+		return -1;
+	}
+
+	atlas->entries = entries;
+	atlas->mask = size - 1;
+	atlas->count = 0;
+
+	for(uint32_t i = 0; i < old_size; i++) {
+		if(old[i].key && old[i].page != drop) {
+			atlas->entries[atlas_slot(atlas, old[i].key)] = old[i];
+			atlas->count++;
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
+static void skyline_reset(magma_vk_atlas_page_t *page) {
+	page->skyline[0] = (magma_vk_skyline_t){ .x = 0, .y = 0, .width = MAGMA_VK_ATLAS_SIZE };
+	page->n_skyline = 1;
+}
+
+/*lowest y a width x height box starting at node i fits at, -1 if it doesn't*/
+static int skyline_fit(const magma_vk_atlas_page_t *page, uint32_t i, int width, int height) {
+	int y = 0;
+
+	if(page->skyline[i].x + width > MAGMA_VK_ATLAS_SIZE) {
+		return -1;
+	}
+
+	for(int left = width; left > 0; i++) {
+		if(page->skyline[i].y > y) {
+			y = page->skyline[i].y;
+		}
+		if(y + height > MAGMA_VK_ATLAS_SIZE) {
+			return -1;
+		}
+		left -= page->skyline[i].width;
+	}
+
+	return y;
+}
+
+/*place a box on the page, lowest first then narrowest node*/
+static bool skyline_pack(magma_vk_atlas_page_t *page, int width, int height, uint16_t *x, uint16_t *y) {
+	int best = -1, best_y = MAGMA_VK_ATLAS_SIZE, best_width = MAGMA_VK_ATLAS_SIZE + 1, fit;
+	magma_vk_skyline_t *node;
+	uint32_t i;
+
+	for(i = 0; i < page->n_skyline; i++) {
+		fit = skyline_fit(page, i, width, height);
+		if(fit < 0) {
+			continue;
+		}
+		if(fit < best_y || (fit == best_y && page->skyline[i].width < best_width)) {
+			best = i;
+			best_y = fit;
+			best_width = page->skyline[i].width;
+		}
+	}
+
+	if(best < 0) {
+		return false;
+	}
+
+	*x = page->skyline[best].x;
+	*y = best_y;
+
+	/*the box becomes a new node, the ones it covers shrink or go*/
+	memmove(&page->skyline[best + 1], &page->skyline[best],
+			(page->n_skyline - best) * sizeof(magma_vk_skyline_t));
+	page->skyline[best] = (magma_vk_skyline_t){ .x = *x, .y = best_y + height, .width = width };
+	page->n_skyline++;
+
+	for(i = best + 1; i < page->n_skyline;) {
+		node = &page->skyline[i];
+		if(node->x >= *x + width) {
+			break;
+		}
+
+		if(node->x + node->width <= *x + width) {
+			memmove(node, node + 1, (page->n_skyline - i - 1) * sizeof(magma_vk_skyline_t));
+			page->n_skyline--;
+			continue;
+		}
+
+		node->width -= *x + width - node->x;
+		node->x = *x + width;
+		break;
+	}
+
+	/*neighbours at the same height are one edge*/
+	for(i = 0; i + 1 < page->n_skyline;) {
+		if(page->skyline[i].y == page->skyline[i + 1].y) {
+			page->skyline[i].width += page->skyline[i + 1].width;
+			memmove(&page->skyline[i + 1], &page->skyline[i + 2],
+					(page->n_skyline - i - 2) * sizeof(magma_vk_skyline_t));
+			page->n_skyline--;
+		} else {
+			i++;
+		}
+	}
+
+	return true;
+}
+
+static VkResult atlas_create_page(magma_vk_renderer_t *vk, magma_vk_atlas_page_t *page) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+	VkImageCreateInfo imageInfo = { 0 };
+	VkMemoryAllocateInfo memAlloc = { 0 };
+	VkMemoryRequirements memReqs = { 0 };
+	VkImageViewCreateInfo viewInfo = { 0 };
+	VkDescriptorSetAllocateInfo setInfo = { 0 };
+	VkDescriptorImageInfo descImage = { 0 };
+	VkWriteDescriptorSet write = { 0 };
+	VkResult res;
+
+	/*a page has at most one node per column*/
+	page->skyline = calloc(MAGMA_VK_ATLAS_SIZE, sizeof(magma_vk_skyline_t));
+	if(!page->skyline) {
+		magma_log_error("Failed to allocate atlas skyline\n");
+		res = VK_ERROR_OUT_OF_HOST_MEMORY;
+		goto err_skyline;
+	}
+	skyline_reset(page);
+
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R8_UNORM;
+	imageInfo.extent.depth = 1;
+	imageInfo.extent.width = MAGMA_VK_ATLAS_SIZE;
+	imageInfo.extent.height = MAGMA_VK_ATLAS_SIZE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.arrayLayers = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	res = vkCreateImage(vk->device, &imageInfo, vk->alloc, &page->image);
+	if(res) {
+		magma_log_error("Failed to create atlas page %d\n", res);
+		goto err_image;
+	}
+	page->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	vkGetImageMemoryRequirements(vk->device, page->image, &memReqs);
+
+	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAlloc.allocationSize = memReqs.size;
+	memAlloc.memoryTypeIndex = getMemoryTypeIndex(vk->phy_dev, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	res = vkAllocateMemory(vk->device, &memAlloc, vk->alloc, &page->memory);
+	if(res) {
+		magma_log_error("Failed to allocate atlas page memory %d\n", res);
+		goto err_memory;
+	}
+	vkBindImageMemory(vk->device, page->image, page->memory, 0);
+
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.format = VK_FORMAT_R8_UNORM;
+	viewInfo.image = page->image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	res = vkCreateImageView(vk->device, &viewInfo, vk->alloc, &page->view);
+	if(res) {
+		magma_log_error("Failed to create atlas page view %d\n", res);
+		goto err_view;
+	}
+
+	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setInfo.descriptorPool = atlas->pool;
+	setInfo.descriptorSetCount = 1;
+	setInfo.pSetLayouts = &atlas->set_layout;
+
+	res = vkAllocateDescriptorSets(vk->device, &setInfo, &page->set);
+	if(res) {
+		magma_log_error("Failed to allocate atlas descriptor set %d\n", res);
+		goto err_set;
+	}
+
+	descImage.sampler = atlas->sampler;
+	descImage.imageView = page->view;
+	descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = page->set;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &descImage;
+	vkUpdateDescriptorSets(vk->device, 1, &write, 0, NULL);
+
+	page->last_used = atlas->frame;
+	return VK_SUCCESS;
+
+err_set:
+	vkDestroyImageView(vk->device, page->view, vk->alloc);
+err_view:
+	vkFreeMemory(vk->device, page->memory, vk->alloc);
+err_memory:
+	vkDestroyImage(vk->device, page->image, vk->alloc);
+err_image:
+	free(page->skyline);
+err_skyline:
+	return res;
+}
+
+static void atlas_destroy_page(magma_vk_renderer_t *vk, magma_vk_atlas_page_t *page) {
+	vkDestroyImageView(vk->device, page->view, vk->alloc);
+	vkFreeMemory(vk->device, page->memory, vk->alloc);
+	vkDestroyImage(vk->device, page->image, vk->alloc);
+	free(page->skyline);
+}
+
+/*empty the least recently used page, -1 if every page is used this frame*/
+static int atlas_evict(magma_vk_atlas_t *atlas) {
+	int victim = -1;
+	uint32_t n = 0;
+
+	for(uint32_t i = 0; i < atlas->n_pages; i++) {
+		if(atlas->pages[i].last_used == atlas->frame) {
+			continue;
+		}
+		if(victim < 0 || atlas->pages[i].last_used < atlas->pages[victim].last_used) {
+			victim = i;
+		}
+	}
+
+	if(victim < 0 || atlas_rehash(atlas, atlas->mask + 1, victim) < 0) {
+		return -1;
+	}
+
+	/*copies still queued for the old glyphs are pointless now*/
+	for(uint32_t i = 0; i < atlas->n_regions; i++) {
+		if(atlas->region_page[i] != victim) {
+			atlas->regions[n] = atlas->regions[i];
+			atlas->region_page[n++] = atlas->region_page[i];
+		}
+	}
+	atlas->n_regions = n;
+
+	skyline_reset(&atlas->pages[victim]);
+	magma_log_debug("Evicted glyph atlas page %d\n", victim);
+	return victim;
+}
+
+/*widen a glyph's bitmap to a byte per pixel in the staging buffer*/
+static void atlas_stage(uint8_t *dst, const magma_glyph_t *glyph, const uint8_t *bitmap) {
+	const uint8_t *row;
+
+	for(int y = 0; y < glyph->rows; y++) {
+		row = &bitmap[y * glyph->pitch];
+		if(glyph->format == MAGMA_GLYPH_FORMAT_GRAY) {
+			memcpy(&dst[y * glyph->width], row, glyph->width);
+			continue;
+		}
+
+		for(int x = 0; x < glyph->width; x++) {
+			dst[y * glyph->width + x] = row[x >> 3] & (0x80 >> (x & 7)) ? 0xff : 0;
+		}
+	}
+}
+
+/*copy the staged glyphs to their pages and wait for it*/
+static int atlas_upload(magma_vk_renderer_t *vk) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+	VkCommandBufferBeginInfo beginInfo = { 0 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	VkImageMemoryBarrier barrier = { 0 };
+	VkSubmitInfo submitInfo = { 0 };
+	uint32_t first;
+	VkResult res;
+
+	if(atlas->n_regions == 0) {
+		return 0;
+	}
+
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(atlas->upload, &beginInfo);
+
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange = range;
+
+	for(uint32_t i = 0; i < atlas->n_pages; i++) {
+		magma_vk_atlas_page_t *page = &atlas->pages[i];
+
+		for(first = 0; first < atlas->n_regions && atlas->region_page[first] != i; first++);
+		if(first == atlas->n_regions) {
+			continue;
+		}
+
+		barrier.image = page->image;
+		barrier.oldLayout = page->layout;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(atlas->upload, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, NULL, 0, NULL, 1, &barrier);
+
+		/*regions of a page are copied in runs, in the order they were staged*/
+		for(uint32_t j = first, n; j < atlas->n_regions; j += n) {
+			n = 1;
+			if(atlas->region_page[j] != i) {
+				continue;
+			}
+			while(j + n < atlas->n_regions && atlas->region_page[j + n] == i) {
+				n++;
+			}
+			vkCmdCopyBufferToImage(atlas->upload, atlas->staging, page->image,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n, &atlas->regions[j]);
+		}
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(atlas->upload, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0, 0, NULL, 0, NULL, 1, &barrier);
+		page->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
+	vkEndCommandBuffer(atlas->upload);
+
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &atlas->upload;
+
+	/*the staging buffer is reused right after, so wait for the copy*/
+	res = vkQueueSubmit(vk->queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if(res == VK_SUCCESS) {
+		res = vkQueueWaitIdle(vk->queue);
+	}
+	vkResetCommandBuffer(atlas->upload, 0);
+
+	atlas->n_regions = 0;
+	atlas->staging_used = 0;
+
+	if(res) {
+		magma_log_error("Failed to upload glyphs to the atlas %d\n", res);
+		return -1;
+	}
+	return 0;
+}
+
+const magma_vk_atlas_glyph_t *magma_vk_atlas_lookup(magma_vk_renderer_t *vk, uint64_t key) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+	magma_vk_atlas_glyph_t *entry = &atlas->entries[atlas_slot(atlas, key)];
+
+	if(!entry->key) {
+		return NULL;
+	}
+
+	atlas->pages[entry->page].last_used = atlas->frame;
+	return entry;
+}
+
+const magma_vk_atlas_glyph_t *magma_vk_atlas_insert(magma_vk_renderer_t *vk, uint64_t key,
+		const magma_glyph_t *glyph, const uint8_t *bitmap) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+	magma_vk_atlas_glyph_t *entry;
+	size_t size = (size_t)glyph->width * glyph->rows;
+	uint16_t x, y;
+	int page = -1;
+
+	if(glyph->width + ATLAS_PADDING > MAGMA_VK_ATLAS_SIZE || glyph->rows + ATLAS_PADDING > MAGMA_VK_ATLAS_SIZE) {
+		return NULL;
+	}
+
+	if(atlas->staging_used + size > MAGMA_VK_ATLAS_STAGING || atlas->n_regions == MAGMA_VK_ATLAS_REGIONS) {
+		if(atlas_upload(vk) < 0) {
+			return NULL;
+		}
+	}
+
+	if((atlas->count + 1) * 2 > atlas->mask + 1) {
+		if(atlas_rehash(atlas, (atlas->mask + 1) * 2, -1) < 0) {
+			return NULL;
+		}
+	}
+
+	/*the most recently made page is the emptiest*/
+	for(int i = atlas->n_pages - 1; i >= 0; i--) {
+		if(skyline_pack(&atlas->pages[i], glyph->width + ATLAS_PADDING, glyph->rows + ATLAS_PADDING, &x, &y)) {
+			page = i;
+			break;
+		}
+	}
+
+	if(page < 0 && atlas->n_pages < MAGMA_VK_ATLAS_PAGES) {
+		if(atlas_create_page(vk, &atlas->pages[atlas->n_pages]) == VK_SUCCESS) {
+			page = atlas->n_pages++;
+			skyline_pack(&atlas->pages[page], glyph->width + ATLAS_PADDING, glyph->rows + ATLAS_PADDING, &x, &y);
+		}
+	}
+
+	if(page < 0) {
+		page = atlas_evict(atlas);
+		if(page < 0) {
+			return NULL;
+		}
+		skyline_pack(&atlas->pages[page], glyph->width + ATLAS_PADDING, glyph->rows + ATLAS_PADDING, &x, &y);
+	}
+
+	if(size) {
+		atlas_stage(&atlas->staging_map[atlas->staging_used], glyph, bitmap);
+		atlas->regions[atlas->n_regions] = (VkBufferImageCopy){
+			.bufferOffset = atlas->staging_used,
+			.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 },
+			.imageOffset = { .x = x, .y = y },
+			.imageExtent = { .width = glyph->width, .height = glyph->rows, .depth = 1 },
+		};
+		atlas->region_page[atlas->n_regions++] = page;
+		atlas->staging_used += size;
+	}
+
+	atlas->pages[page].last_used = atlas->frame;
+
+	entry = &atlas->entries[atlas_slot(atlas, key)];
+	*entry = (magma_vk_atlas_glyph_t){
+		.key = key,
+		.page = page,
+		.x = x,
+		.y = y,
+		.width = glyph->width,
+		.height = glyph->rows,
+	};
+	atlas->count++;
+	return entry;
+}
+
+int magma_vk_atlas_flush(magma_vk_renderer_t *vk) {
+	int ret = atlas_upload(vk);
+
+	vk->atlas.frame++;
+	return ret;
+}
+
+VkResult magma_vk_create_atlas(magma_vk_renderer_t *vk) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+	VkSamplerCreateInfo samplerInfo = { 0 };
+	VkDescriptorSetLayoutBinding binding = { 0 };
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { 0 };
+	VkDescriptorPoolSize poolSize = { 0 };
+	VkDescriptorPoolCreateInfo poolInfo = { 0 };
+	VkBufferCreateInfo bufferInfo = { 0 };
+	VkMemoryAllocateInfo memAlloc = { 0 };
+	VkMemoryRequirements memReqs = { 0 };
+	VkCommandBufferAllocateInfo allocInfo = { 0 };
+	void *map;
+	VkResult res;
+
+	if(atlas_rehash(atlas, ATLAS_ENTRIES_INITIAL, -1) < 0) {
+		res = VK_ERROR_OUT_OF_HOST_MEMORY;
+		goto err_entries;
+	}
+
+	/*glyphs are drawn texel for pixel, nearest never blurs them*/
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.unnormalizedCoordinates = VK_TRUE;
+
+	res = vkCreateSampler(vk->device, &samplerInfo, vk->alloc, &atlas->sampler);
+	if(res) {
+		magma_log_error("Failed to create atlas sampler %d\n", res);
+		goto err_sampler;
+	}
+
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	res = vkCreateDescriptorSetLayout(vk->device, &layoutInfo, vk->alloc, &atlas->set_layout);
+	if(res) {
+		magma_log_error("Failed to create atlas descriptor set layout %d\n", res);
+		goto err_set_layout;
+	}
+
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = MAGMA_VK_ATLAS_PAGES;
+
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = MAGMA_VK_ATLAS_PAGES;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	res = vkCreateDescriptorPool(vk->device, &poolInfo, vk->alloc, &atlas->pool);
+	if(res) {
+		magma_log_error("Failed to create atlas descriptor pool %d\n", res);
+		goto err_pool;
+	}
+
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = MAGMA_VK_ATLAS_STAGING;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	res = vkCreateBuffer(vk->device, &bufferInfo, vk->alloc, &atlas->staging);
+	if(res) {
+		magma_log_error("Failed to create atlas staging buffer %d\n", res);
+		goto err_staging;
+	}
+
+	vkGetBufferMemoryRequirements(vk->device, atlas->staging, &memReqs);
+
+	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAlloc.allocationSize = memReqs.size;
+	memAlloc.memoryTypeIndex = getMemoryTypeIndex(vk->phy_dev, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	res = vkAllocateMemory(vk->device, &memAlloc, vk->alloc, &atlas->staging_mem);
+	if(res) {
+		magma_log_error("Failed to allocate atlas staging memory %d\n", res);
+		goto err_staging_mem;
+	}
+	vkBindBufferMemory(vk->device, atlas->staging, atlas->staging_mem, 0);
+
+	/*stays mapped, inserts write straight into it*/
+	res = vkMapMemory(vk->device, atlas->staging_mem, 0, MAGMA_VK_ATLAS_STAGING, 0, &map);
+	if(res) {
+		magma_log_error("Failed to map atlas staging memory %d\n", res);
+		goto err_map;
+	}
+	atlas->staging_map = map;
+
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = vk->command_pool;
+	allocInfo.commandBufferCount = 1;
+
+	res = vkAllocateCommandBuffers(vk->device, &allocInfo, &atlas->upload);
+	if(res) {
+		magma_log_error("Failed to allocate atlas upload buffer %d\n", res);
+		goto err_upload;
+	}
+
+	return VK_SUCCESS;
+
+err_upload:
+	vkUnmapMemory(vk->device, atlas->staging_mem);
+err_map:
+	vkFreeMemory(vk->device, atlas->staging_mem, vk->alloc);
+err_staging_mem:
+	vkDestroyBuffer(vk->device, atlas->staging, vk->alloc);
+err_staging:
+	vkDestroyDescriptorPool(vk->device, atlas->pool, vk->alloc);
+err_pool:
+	vkDestroyDescriptorSetLayout(vk->device, atlas->set_layout, vk->alloc);
+err_set_layout:
+	vkDestroySampler(vk->device, atlas->sampler, vk->alloc);
+err_sampler:
+	free(atlas->entries);
+	atlas->entries = NULL;
+err_entries:
+	return res;
+}
+
+void magma_vk_destroy_atlas(magma_vk_renderer_t *vk) {
+	magma_vk_atlas_t *atlas = &vk->atlas;
+
+	for(uint32_t i = 0; i < atlas->n_pages; i++) {
+		atlas_destroy_page(vk, &atlas->pages[i]);
+	}
+
+	vkFreeCommandBuffers(vk->device, vk->command_pool, 1, &atlas->upload);
+	vkUnmapMemory(vk->device, atlas->staging_mem);
+	vkFreeMemory(vk->device, atlas->staging_mem, vk->alloc);
+	vkDestroyBuffer(vk->device, atlas->staging, vk->alloc);
+	/*the page sets go with their pool*/
+	vkDestroyDescriptorPool(vk->device, atlas->pool, vk->alloc);
+	vkDestroyDescriptorSetLayout(vk->device, atlas->set_layout, vk->alloc);
+	vkDestroySampler(vk->device, atlas->sampler, vk->alloc);
+	free(atlas->entries);
+}
@@ -150,6 +150,8 @@ VkResult magmaVkCreatePipeline(magma_vk_renderer_t *vk) {
 
 
 	pipelineLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayout.setLayoutCount = 1;
+	pipelineLayout.pSetLayouts = &vk->atlas.set_layout;
 
 	vkCreatePipelineLayout(vk->device, &pipelineLayout, vk->alloc, &vk->pipeline_layout);
 
@@ -57,6 +57,10 @@ void insertImageMemoryBarrier(
 magma_buf_t *magma_vk_draw(magma_vk_renderer_t *vk) {
 	static magma_buf_t buf;
 	VkCommandBufferBeginInfo beginInfo = { 0 };
+
+	/*glyphs inserted since the last frame have to be on their pages*/
+	magma_vk_atlas_flush(vk);
+
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	vkBeginCommandBuffer(vk->draw_buffer, &beginInfo);
 
@@ -280,13 +284,26 @@ magma_vk_renderer_t *magma_vk_renderer_init(magma_backend_t *backend) {
 
 	/*TODO: CHECK*/
 	magmaVkCreateRenderPass(vk);
+	magmaVkCreateCommandPool(vk);
+
+	/*the pipeline layout takes the atlas descriptor set layout*/
+	res = magma_vk_create_atlas(vk);
+	if(res) {
+		magma_log_error("Failed to create glyph atlas\n");
+		goto error_vk_create_atlas;
+	}
+
 	magmaVkCreatePipeline(vk);
 	magmaVkCreateImageView(vk);
 	magmaVkCreateDstImageView(vk);
-	magmaVkCreateCommandPool(vk);
 	magma_vk_create_framebuffer(vk);
 
 	return vk;
+error_vk_create_atlas:
+	vkFreeCommandBuffers(vk->device, vk->command_pool, 1, &vk->draw_buffer);
+	vkDestroyCommandPool(vk->device, vk->command_pool, vk->alloc);
+	vkDestroyRenderPass(vk->device, vk->render_pass, vk->alloc);
+	vkDestroyDevice(vk->device, vk->alloc);
 error_vk_create_device:
 
 error_vk_get_phsyical_dev:
@@ -323,6 +340,8 @@ void magma_vk_renderer_deinit(magma_vk_renderer_t *vk) {
 
 	vkDestroyImage(vk->device, vk->vk_image, vk->alloc);
 
+	magma_vk_destroy_atlas(vk);
+
 	vkFreeCommandBuffers(vk->device, vk->command_pool, 1, &vk->draw_buffer);
 
 	vkDestroyCommandPool(vk->device, vk->command_pool, vk->alloc);
@@ -0,0 +1,314 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magma/logger/log.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+/* Grapheme cluster table.
+ *
+ * A cell holds one code point, a cluster of more than one
+ * (a base with combining marks, a ZWJ emoji sequence, a flag)
+ * is interned here and the cell holds its id with
+ * MAGMA_GLYPH_CLUSTER set instead. The code points live back
+ * to back in one arena. When the ids or the arena run out the
+ * clusters no cell refers to anymore are freed and the arena
+ * compacted, packed scrollback stores the code points so the
+ * clusters only it used go away once their rows are packed.
+ */
+
+#define CLUSTERS_MAX (MAGMA_GLYPH_CLUSTER - 1)
+
+static inline uint32_t cluster_hash(const utf32_t *cps, int len) {
+	uint32_t h = 0x811c9dc5;
+
+	for(int i = 0; i < len; i++) {
+		h = (h ^ cps[i]) * 0x01000193;
+	}
+
+	return h ^ (h >> 15);
+}
+
+static inline bool cluster_equal(const magma_clusters_t *clusters, uint32_t id,
+		const utf32_t *cps, int len) {
+	const magma_cluster_t *cluster = &clusters->entries[id];
+
+	return cluster->len == (uint32_t)len &&
+		memcmp(&clusters->data[cluster->offset], cps, len * sizeof(utf32_t)) == 0;
+}
+
+/*slot holding the cluster, or the empty slot it would go in*/
+static uint32_t clusters_find(const magma_clusters_t *clusters, const utf32_t *cps, int len) {
+	uint32_t slot = cluster_hash(cps, len) & clusters->hash_mask;
+
+	while(clusters->hash[slot] && !cluster_equal(clusters, clusters->hash[slot], cps, len)) {
+		slot = (slot + 1) & clusters->hash_mask;
+	}
+
+	return slot;
+}
+
+static int clusters_rehash(magma_clusters_t *clusters, uint32_t size) {
+	const magma_cluster_t *cluster;
+	uint32_t *hash;
+
+	hash = calloc(size, sizeof(uint32_t));
+	if(!hash) {
+		magma_log_error("Failed to allocate cluster hash\n");
+		return -1;
+	}
+
+	free(clusters->hash);
+	clusters->hash = hash;
+	clusters->hash_mask = size - 1;
+
+	for(uint32_t i = 1; i < clusters->count; i++) {
+		cluster = &clusters->entries[i];
+		if(cluster->len) {
+			clusters->hash[clusters_find(clusters, &clusters->data[cluster->offset], cluster->len)] = i;
+		}
+	}
+
+	return 0;
+}
+
+static int clusters_grow(magma_clusters_t *clusters) {
+	magma_cluster_t *entries;
+	uint32_t *free_list;
+	uint32_t capacity = clusters->capacity * 2;
+
+	if(capacity > CLUSTERS_MAX) {
+		return -1;
+	}
+
+	entries = realloc(clusters->entries, capacity * sizeof(magma_cluster_t));
+	if(!entries) {
+		magma_log_error("Failed to grow cluster table to %u\n", capacity);
+		return -1;
+	}
+	clusters->entries = entries;
+
+	free_list = realloc(clusters->free_list, capacity * sizeof(uint32_t));
+	if(!free_list) {
+		magma_log_error("Failed to grow cluster free list to %u\n", capacity);
+		return -1;
+	}
+	clusters->free_list = free_list;
+	clusters->capacity = capacity;
+
+	/*keep the hash at most half full*/
+	return clusters_rehash(clusters, capacity * 2);
+}
+
+static int clusters_grow_data(magma_clusters_t *clusters, size_t need) {
+	utf32_t *data;
+	size_t size = clusters->data_size;
+
+	do {
+		size *= 2;
+	} while(size < need);
+
+	data = realloc(clusters->data, size * sizeof(utf32_t));
+	if(!data) {
+		magma_log_error("Failed to grow cluster data to %zu\n", size);
+		return -1;
+	}
+
+	clusters->data = data;
+	clusters->data_size = size;
+	return 0;
+}
+
+static void clusters_mark(uint8_t *live, const glyph_t *cells, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		if(cells[i].unicode & MAGMA_GLYPH_CLUSTER) {
+			live[cells[i].unicode & ~MAGMA_GLYPH_CLUSTER] = 1;
+		}
+	}
+}
+
+/*free every cluster no cell refers to and compact the data*/
+static int clusters_collect(magma_vt_t *vt) {
+	magma_clusters_t *clusters = &vt->clusters;
+	magma_scrollback_t *sb = vt->scrollback;
+	const magma_sb_row_t *row;
+	magma_cluster_t *cluster;
+	uint8_t *live;
+	utf32_t *data;
+	size_t used = 0;
+
+	live = calloc(clusters->capacity, 1);
+	data = malloc(clusters->data_size * sizeof(utf32_t));
+	if(!live || !data) {
+		magma_log_error("Failed to allocate cluster marks\n");
+		free(live);
+		free(data);
+		return -1;
+	}
+
+	clusters_mark(live, &(glyph_t){ .unicode = vt->last }, 1);
+	clusters_mark(live, vt->grid->slab, (size_t)vt->rows * vt->cols);
+	if(vt->other) {
+		clusters_mark(live, vt->other->slab, (size_t)vt->rows * vt->cols);
+	}
+	clusters_mark(live, clusters->pinned, clusters->n_pinned);
+	for(size_t i = 0; sb && i < sb->n_recent; i++) {
+		row = &sb->recent[(sb->recent_head + i) % MAGMA_SB_RECENT];
+		clusters_mark(live, row->cells, row->len);
+	}
+
+	clusters->n_free = 0;
+	for(uint32_t i = clusters->count; i-- > 1;) {
+		cluster = &clusters->entries[i];
+		if(!live[i]) {
+			cluster->len = 0;
+			clusters->free_list[clusters->n_free++] = i;
+		}
+	}
+
+	clusters->generation++;
+
+	/*ids keep their order in the arena, copy the live ones down*/
+	for(uint32_t i = 1; i < clusters->count; i++) {
+		cluster = &clusters->entries[i];
+		if(cluster->len) {
+			memcpy(&data[used], &clusters->data[cluster->offset], cluster->len * sizeof(utf32_t));
+			cluster->offset = used;
+			used += cluster->len;
+		}
+	}
+
+	free(clusters->data);
+	clusters->data = data;
+	clusters->data_used = used;
+
+	if(clusters_rehash(clusters, clusters->hash_mask + 1) < 0) {
+		free(live);
+		return -1;
+	}
+
+	magma_log_debug("Collected %u of %u clusters\n", clusters->n_free, clusters->count);
+	free(live);
+	return 0;
+}
+
+int magma_clusters_init(magma_clusters_t *clusters) {
+	memset(clusters, 0, sizeof(*clusters));
+
+	clusters->entries = calloc(MAGMA_CLUSTERS_INITIAL, sizeof(magma_cluster_t));
+	if(!clusters->entries) {
+		magma_log_error("Failed to allocate cluster table\n");
+		goto err_entries;
+	}
+
+	clusters->free_list = malloc(MAGMA_CLUSTERS_INITIAL * sizeof(uint32_t));
+	if(!clusters->free_list) {
+		magma_log_error("Failed to allocate cluster free list\n");
+		goto err_free_list;
+	}
+
+	clusters->data = malloc(MAGMA_CLUSTERS_DATA_INITIAL * sizeof(utf32_t));
+	if(!clusters->data) {
+		magma_log_error("Failed to allocate cluster data\n");
+		goto err_data;
+	}
+
+	clusters->data_size = MAGMA_CLUSTERS_DATA_INITIAL;
+	clusters->capacity = MAGMA_CLUSTERS_INITIAL;
+	clusters->count = 1;
+	if(clusters_rehash(clusters, MAGMA_CLUSTERS_INITIAL * 2) < 0) {
+		goto err_hash;
+	}
+
+	return 0;
+
+err_hash:
+	free(clusters->data);
+err_data:
+	free(clusters->free_list);
+err_free_list:
+	free(clusters->entries);
+err_entries:
+	return -1;
+}
+
+void magma_clusters_deinit(magma_clusters_t *clusters) {
+	free(clusters->hash);
+	free(clusters->data);
+	free(clusters->free_list);
+	free(clusters->entries);
+}
+
+utf32_t magma_clusters_intern(magma_vt_t *vt, const utf32_t *cps, int len) {
+	magma_clusters_t *clusters = &vt->clusters;
+	magma_cluster_t *cluster;
+	uint32_t slot, id;
+	bool full;
+
+	slot = clusters_find(clusters, cps, len);
+	if(clusters->hash[slot]) {
+		return MAGMA_GLYPH_CLUSTER | clusters->hash[slot];
+	}
+
+	/* collect before growing, grow when that freed less than
+	 * a quarter so a screen full of distinct clusters doesn't
+	 * collect on every new one
+	 */
+	full = clusters->n_free == 0 && clusters->count == clusters->capacity;
+	if(full || clusters->data_used + len > clusters->data_size) {
+		clusters_collect(vt);
+
+		if(clusters->n_free < clusters->capacity / 4) {
+			clusters_grow(clusters);
+		}
+
+		if(clusters->data_used + len > clusters->data_size * 3 / 4) {
+			clusters_grow_data(clusters, clusters->data_used + len);
+		}
+	}
+
+	if(clusters->data_used + len > clusters->data_size) {
+		magma_log_warn("Cluster data is full\n");
+		return 0;
+	}
+
+	if(clusters->n_free) {
+		id = clusters->free_list[--clusters->n_free];
+	} else if(clusters->count < clusters->capacity) {
+		id = clusters->count++;
+	} else {
+		magma_log_warn("Cluster table is full\n");
+		return 0;
+	}
+
+	cluster = &clusters->entries[id];
+	cluster->offset = clusters->data_used;
+	cluster->len = len;
+	memcpy(&clusters->data[cluster->offset], cps, len * sizeof(utf32_t));
+	clusters->data_used += len;
+
+	/*growing or collecting rebuilt the hash*/
+	slot = clusters_find(clusters, cps, len);
+	clusters->hash[slot] = id;
+
+	return MAGMA_GLYPH_CLUSTER | id;
+}
+
+utf32_t magma_clusters_append(magma_vt_t *vt, utf32_t unicode, utf32_t cp) {
+	utf32_t cps[MAGMA_CLUSTER_MAX], cluster;
+	const utf32_t *base;
+	int len;
+
+	base = magma_vt_cluster(vt, &(glyph_t){ .unicode = unicode }, &len);
+	if(len >= MAGMA_CLUSTER_MAX) {
+		return unicode;
+	}
+
+	memcpy(cps, base, len * sizeof(utf32_t));
+	cps[len++] = cp;
+
+	cluster = magma_clusters_intern(vt, cps, len);
+	return cluster ? cluster : unicode;
+}
@@ -0,0 +1,44 @@
+#include <stdint.h>
+
+#include <magma/vt.h>
+
+/*xterm's defaults for the 16 standard and bright colors*/
+static const uint32_t vt_palette_16[16] = {
+	0x000000, 0xcd0000, 0x00cd00, 0xcdcd00,
+	0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+	0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00,
+	0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+};
+
+/*channel levels of the 6x6x6 color cube*/
+static const uint8_t vt_cube_levels[6] = { 0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff };
+
+static uint32_t vt_palette_lookup(uint8_t index) {
+	uint8_t r, g, b, gray;
+
+	if(index < 16) {
+		return vt_palette_16[index];
+	}
+
+	if(index < 232) {
+		index -= 16;
+		r = vt_cube_levels[index / 36];
+		g = vt_cube_levels[(index / 6) % 6];
+		b = vt_cube_levels[index % 6];
+		return (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+	}
+
+	gray = 8 + (index - 232) * 10;
+	return (uint32_t)gray << 16 | (uint32_t)gray << 8 | gray;
+}
+
+uint32_t magma_vt_color_resolve(uint32_t color, uint32_t def) {
+	switch(MAGMA_COLOR_TYPE(color)) {
+		case MAGMA_COLOR_TYPE_INDEXED:
+			return 0xff000000 | vt_palette_lookup(color & 0xff);
+		case MAGMA_COLOR_TYPE_RGB:
+			return 0xff000000 | (color & 0xffffff);
+		default:
+			return def;
+	}
+}
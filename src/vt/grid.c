@@ -0,0 +1,955 @@
+/*madvise and MAP_ANONYMOUS aren't part of XOPEN*/
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <magma/logger/log.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+magma_vt_grid_t *magma_vt_grid_alloc(int rows, int cols) {
+	magma_vt_grid_t *grid;
+	size_t page = sysconf(_SC_PAGESIZE);
+	glyph_t *blank;
+
+	grid = calloc(1, sizeof(*grid));
+	if(!grid) {
+		magma_log_error("Failed to allocate grid\n");
+		goto err_grid;
+	}
+
+	grid->rows = rows;
+	grid->cols = cols;
+
+	/*untouched pages of a big slab don't take up any memory*/
+	grid->n_pages = ((size_t)rows * cols * sizeof(glyph_t) + page - 1) / page;
+	grid->slab = mmap(NULL, grid->n_pages * page, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(grid->slab == MAP_FAILED) {
+		magma_log_error("Failed to allocate %dx%d grid: %m\n", rows, cols);
+		goto err_slab;
+	}
+
+	/*followed by a byte per row for grid_release*/
+	grid->released = calloc(grid->n_pages + rows, 1);
+	if(!grid->released) {
+		magma_log_error("Failed to allocate grid page state\n");
+		goto err_released;
+	}
+
+	grid->lines = malloc(rows * sizeof(line_t));
+	if(!grid->lines) {
+		magma_log_error("Failed to allocate grid lines\n");
+		goto err_lines;
+	}
+
+	grid->meta = calloc(rows, sizeof(magma_vt_row_t));
+	if(!grid->meta) {
+		magma_log_error("Failed to allocate grid row state\n");
+		goto err_meta;
+	}
+
+	grid->spare = malloc(rows * sizeof(glyph_t *));
+	if(!grid->spare) {
+		magma_log_error("Failed to allocate grid spare rows\n");
+		goto err_spare;
+	}
+
+	/*whole pages so a stray write to it faults instead of showing up everywhere*/
+	grid->blank_size = ((size_t)cols * sizeof(glyph_t) + page - 1) / page * page;
+	blank = aligned_alloc(page, grid->blank_size);
+	if(!blank) {
+		magma_log_error("Failed to allocate blank row\n");
+		goto err_blank;
+	}
+	memset(blank, 0, grid->blank_size);
+	if(mprotect(blank, grid->blank_size, PROT_READ) < 0) {
+		magma_log_warn("mprotect: %m\n");
+	}
+	grid->blank = blank;
+
+	/*the first row of the slab is handed out first*/
+	for(int i = 0; i < rows; i++) {
+		grid->spare[i] = &grid->slab[(size_t)(rows - 1 - i) * cols];
+		grid->lines[i] = blank;
+	}
+	grid->n_spare = rows;
+	grid->spare_scan = rows;
+
+	return grid;
+
+err_blank:
+	free(grid->spare);
+err_spare:
+	free(grid->meta);
+err_meta:
+	free(grid->lines);
+err_lines:
+	free(grid->released);
+err_released:
+	munmap(grid->slab, grid->n_pages * page);
+err_slab:
+	free(grid);
+err_grid:
+	return NULL;
+}
+
+void magma_vt_grid_free(magma_vt_grid_t *grid) {
+	if(!grid) {
+		return;
+	}
+
+	mprotect((void *)grid->blank, grid->blank_size, PROT_READ | PROT_WRITE);
+	free((void *)grid->blank);
+	free(grid->spare);
+	free(grid->meta);
+	free(grid->lines);
+	free(grid->released);
+	munmap(grid->slab, grid->n_pages * sysconf(_SC_PAGESIZE));
+	free(grid);
+}
+
+/* give slab pages back to the kernel once every row on them is
+ * spare, they read as zeroes when a row on them is taken again.
+ * Only looked for when enough rows were shared to fill a page
+ */
+static void grid_release(magma_vt_grid_t *grid) {
+	size_t page = sysconf(_SC_PAGESIZE), row_size = grid->cols * sizeof(glyph_t);
+	uint8_t *spare = &grid->released[grid->n_pages];
+	size_t first, last, run = 0;
+	int per_page = page / row_size ? page / row_size : 1;
+	bool empty;
+
+	if(grid->n_spare - grid->spare_scan < per_page) {
+		return;
+	}
+	grid->spare_scan = grid->n_spare;
+
+	memset(spare, 0, grid->rows);
+	for(int i = 0; i < grid->n_spare; i++) {
+		spare[(grid->spare[i] - grid->slab) / grid->cols] = 1;
+	}
+
+	/*one past the last page ends the last run*/
+	for(size_t p = 0; p <= grid->n_pages; p++) {
+		empty = p < grid->n_pages && !grid->released[p];
+		if(empty) {
+			first = p * page / row_size;
+			last = ((p + 1) * page - 1) / row_size;
+			last = last < (size_t)grid->rows ? last : (size_t)grid->rows - 1;
+			for(size_t r = first; r <= last && empty; r++) {
+				empty = spare[r];
+			}
+		}
+
+		if(empty) {
+			run++;
+			continue;
+		}
+		if(run && madvise((uint8_t *)grid->slab + (p - run) * page, run * page, MADV_DONTNEED) == 0) {
+			memset(&grid->released[p - run], 1, run);
+			grid->released_size += run * page;
+			magma_log_debug("Released %zu grid pages, %zu bytes released\n", run, grid->released_size);
+		}
+		run = 0;
+	}
+}
+
+glyph_t *magma_vt_grid_take(magma_vt_grid_t *grid) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	glyph_t *cells = grid->spare[--grid->n_spare];
+	size_t first = (cells - grid->slab) * sizeof(glyph_t) / page;
+	size_t last = ((cells - grid->slab + grid->cols) * sizeof(glyph_t) - 1) / page;
+
+	/*the memset faults the pages back in*/
+	for(size_t p = first; p <= last; p++) {
+		if(grid->released[p]) {
+			grid->released[p] = 0;
+			grid->released_size -= page;
+		}
+	}
+	if(grid->n_spare < grid->spare_scan) {
+		grid->spare_scan = grid->n_spare;
+	}
+
+	memset(cells, 0, grid->cols * sizeof(glyph_t));
+	return cells;
+}
+
+/*give the cells of a row back and point it at the blank row*/
+static inline void grid_share(magma_vt_grid_t *grid, int index) {
+	if(grid->lines[index] != grid->blank) {
+		grid->spare[grid->n_spare++] = grid->lines[index];
+		grid->lines[index] = (glyph_t *)grid->blank;
+		grid_release(grid);
+	}
+	grid->meta[index].used = 0;
+}
+
+void magma_vt_grid_clear(magma_vt_grid_t *grid, int rows) {
+	for(int i = 0; i < rows; i++) {
+		grid_share(grid, i);
+		grid->meta[i].flags = 0;
+	}
+}
+
+static inline int grid_slot(magma_vt_t *vt, int y) {
+	int index = vt->grid->head + y;
+
+	if(index >= vt->rows) {
+		index -= vt->rows;
+	}
+
+	return index;
+}
+
+static inline bool grid_is_zero(glyph_t cell) {
+	return (cell.unicode | cell.style | cell.flags) == 0;
+}
+
+/* Row kernels behind ECH, EL, ED, ICH, DCH and REP. Each works
+ * on the cells of one row and the ones that can't tell from
+ * their arguments return the column after the last cell they
+ * changed so the damage is exact. Cells past the row's used
+ * length are known to be blank and are never moved.
+ */
+
+/*length of cells without the blank cells at the end*/
+static int grid_used(const glyph_t *cells, int cols) {
+	for(; cols > 0; cols--) {
+		if(!grid_is_zero(cells[cols - 1])) {
+			break;
+		}
+	}
+	return cols;
+}
+
+/*set n cells to cell, a glyph_t is 8 bytes so each 16 byte store writes two*/
+static void grid_fill(glyph_t *cells, int n, glyph_t cell) {
+	uint64_t bits;
+	int i = 0;
+
+	memcpy(&bits, &cell, sizeof(bits));
+	if(bits == 0) {
+		memset(cells, 0, n * sizeof(glyph_t));
+		return;
+	}
+
+#if defined(__SSE2__)
+	__m128i pattern = _mm_set1_epi64x((long long)bits);
+
+	for(; i + 4 <= n; i += 4) {
+		_mm_storeu_si128((__m128i *)&cells[i], pattern);
+		_mm_storeu_si128((__m128i *)&cells[i + 2], pattern);
+	}
+#endif
+
+	for(; i < n; i++) {
+		cells[i] = cell;
+	}
+}
+
+/*ICH, cells from x move right by n and the gap gets blank*/
+static int grid_insert_cells(glyph_t *cells, int cols, int x, int n, glyph_t blank, uint16_t *used) {
+	int end;
+
+	if(*used <= x) {
+		grid_fill(&cells[x], n, blank);
+		*used = x + n;
+		return x + n;
+	}
+
+	end = *used + n < cols ? *used + n : cols;
+	memmove(&cells[x + n], &cells[x], (end - x - n) * sizeof(glyph_t));
+	grid_fill(&cells[x], n, blank);
+
+	*used = end;
+	return end;
+}
+
+/*DCH, cells after x + n move left onto x and blank comes in at the end*/
+static int grid_delete_cells(glyph_t *cells, int cols, int x, int n, glyph_t blank, uint16_t *used) {
+	bool zero = grid_is_zero(blank);
+	int end = zero ? *used : cols;
+
+	if(end <= x) {
+		return x;
+	}
+
+	if(n > end - x) {
+		n = end - x;
+	}
+	memmove(&cells[x], &cells[x + n], (end - x - n) * sizeof(glyph_t));
+	grid_fill(&cells[end - n], n, blank);
+
+	*used = zero ? end - n : cols;
+	return end;
+}
+
+/*reverse the rows first to last inclusive, the row state goes with them*/
+static void grid_reverse(magma_vt_t *vt, int first, int last) {
+	magma_vt_row_t meta;
+	line_t line;
+	int a, b;
+
+	for(; first < last; first++, last--) {
+		a = grid_slot(vt, first);
+		b = grid_slot(vt, last);
+		line = vt->grid->lines[a];
+		vt->grid->lines[a] = vt->grid->lines[b];
+		vt->grid->lines[b] = line;
+		meta = vt->grid->meta[a];
+		vt->grid->meta[a] = vt->grid->meta[b];
+		vt->grid->meta[b] = meta;
+	}
+}
+
+static void grid_record_move(magma_vt_t *vt, int top, int bottom, int count) {
+	magma_vt_move_t *last;
+
+	if(vt->n_moves > MAGMA_VT_MAX_MOVES) {
+		return;
+	}
+
+	vt->dirty = true;
+
+	/*a stream of newlines is a single move*/
+	if(vt->n_moves) {
+		last = &vt->moves[vt->n_moves - 1];
+		if(last->top == top && last->bottom == bottom && (last->count > 0) == (count > 0)) {
+			last->count += count;
+			return;
+		}
+	}
+
+	if(vt->n_moves == MAGMA_VT_MAX_MOVES) {
+		vt->n_moves++;
+		return;
+	}
+
+	vt->moves[vt->n_moves++] = (magma_vt_move_t){ top, bottom, count };
+}
+
+/*push screen rows first to first + n - 1 to the scrollback*/
+static void grid_save(magma_vt_t *vt, int first, int n) {
+	size_t lines;
+
+	if(!vt->scrollback || vt->modes & MAGMA_VT_MODE_ALT) {
+		return;
+	}
+
+	for(int y = first; y < first + n; y++) {
+		magma_scrollback_push(vt->scrollback, vt->grid->lines[grid_slot(vt, y)], vt->cols,
+				vt->grid->meta[grid_slot(vt, y)].flags & MAGMA_ROW_WRAPPED);
+	}
+
+	/* keep a scrolled back view on the same lines, what is
+	 * on screen only changes when it hits the end of the history
+	 */
+	if(vt->view) {
+		lines = magma_scrollback_lines(vt->scrollback, vt->view + n);
+		if(vt->view + n > lines) {
+			vt->view = lines;
+			magma_vt_damage_all(vt);
+		} else {
+			vt->view += n;
+		}
+	}
+}
+
+void magma_vt_grid_scroll(magma_vt_t *vt, int top, int bottom, int count, glyph_t blank) {
+	int height = bottom - top + 1;
+	int n = count < 0 ? -count : count;
+	int first;
+
+	if(n == 0 || height <= 0) {
+		return;
+	}
+
+	if(n > height) {
+		n = height;
+	}
+
+	/*only lines leaving the top of the whole screen are history*/
+	if(top == 0 && bottom == vt->rows - 1 && count > 0 && vt->scrollback &&
+			!(vt->modes & MAGMA_VT_MODE_ALT)) {
+		/*a scrolled back view stays put, nothing moves on screen*/
+		if(vt->view == 0) {
+			grid_record_move(vt, top, bottom, n);
+		}
+		grid_save(vt, 0, n);
+	} else if(vt->view == 0) {
+		grid_record_move(vt, top, bottom, count > 0 ? n : -n);
+	} else {
+		/*the rows are shown lower down the window, just repaint them*/
+		for(int y = top; y <= bottom; y++) {
+			magma_vt_damage(vt, y, 0, vt->cols);
+		}
+	}
+
+	if(top == 0 && bottom == vt->rows - 1 && n < height) {
+		/*whole screen, move where the ring starts*/
+		if(count > 0) {
+			vt->grid->head = (vt->grid->head + n) % vt->rows;
+			first = height - n;
+		} else {
+			vt->grid->head = (vt->grid->head + vt->rows - n) % vt->rows;
+			first = 0;
+		}
+	} else if(n < height) {
+		/*rotate the region by reversing both parts and then the whole*/
+		if(count > 0) {
+			grid_reverse(vt, top, top + n - 1);
+			grid_reverse(vt, top + n, bottom);
+			first = bottom - n + 1;
+		} else {
+			grid_reverse(vt, top, bottom - n);
+			grid_reverse(vt, bottom - n + 1, bottom);
+			first = top;
+		}
+		grid_reverse(vt, top, bottom);
+	} else {
+		first = top;
+	}
+
+	for(int y = first; y < first + n; y++) {
+		magma_vt_grid_erase(vt, y, 0, vt->cols, blank);
+		magma_vt_damage(vt, y, 0, vt->cols);
+	}
+}
+
+void magma_vt_grid_erase(magma_vt_t *vt, int y, int x0, int x1, glyph_t blank) {
+	int index = grid_slot(vt, y);
+	magma_vt_row_t *row = &vt->grid->meta[index];
+
+	if(x1 > vt->cols) {
+		x1 = vt->cols;
+	}
+	if(x0 < 0) {
+		x0 = 0;
+	}
+
+	/*nothing is left to continue on the next row*/
+	if(x0 == 0 && x1 == vt->cols) {
+		row->flags &= ~MAGMA_ROW_WRAPPED;
+	}
+
+	if(!grid_is_zero(blank)) {
+		if(x0 < x1) {
+			grid_fill(&magma_vt_line_write(vt, y)[x0], x1 - x0, blank);
+			magma_vt_damage(vt, y, x0, x1);
+			magma_vt_use(vt, y, x1);
+		}
+		return;
+	}
+
+	/*the cells past used are blank already*/
+	if(x1 > row->used) {
+		x1 = row->used;
+	}
+	if(x0 >= x1) {
+		return;
+	}
+
+	magma_vt_damage(vt, y, x0, x1);
+	if(x0 == 0 && x1 == row->used) {
+		/*nothing is left on the row, it can share the blank row again*/
+		grid_share(vt->grid, index);
+		return;
+	}
+
+	grid_fill(&magma_vt_line_write(vt, y)[x0], x1 - x0, blank);
+	if(x1 == row->used) {
+		row->used = x0;
+	}
+}
+
+void magma_vt_grid_insert(magma_vt_t *vt, int y, int x, int n, glyph_t blank) {
+	magma_vt_row_t *row = magma_vt_row(vt, y);
+	int x1;
+
+	if(n > vt->cols - x) {
+		n = vt->cols - x;
+	}
+	if(n <= 0 || (row->used <= x && grid_is_zero(blank))) {
+		return;
+	}
+
+	x1 = grid_insert_cells(magma_vt_line_write(vt, y), vt->cols, x, n, blank, &row->used);
+	magma_vt_damage(vt, y, x, x1);
+}
+
+void magma_vt_grid_delete(magma_vt_t *vt, int y, int x, int n, glyph_t blank) {
+	magma_vt_row_t *row = magma_vt_row(vt, y);
+	int x1;
+
+	if(n > vt->cols - x) {
+		n = vt->cols - x;
+	}
+	if(n <= 0 || (row->used <= x && grid_is_zero(blank))) {
+		return;
+	}
+
+	x1 = grid_delete_cells(magma_vt_line_write(vt, y), vt->cols, x, n, blank, &row->used);
+	magma_vt_damage(vt, y, x, x1);
+}
+
+void magma_vt_grid_repeat(magma_vt_t *vt, int y, int x, int n, glyph_t cell) {
+	if(n > vt->cols - x) {
+		n = vt->cols - x;
+	}
+	if(n <= 0) {
+		return;
+	}
+
+	grid_fill(&magma_vt_line_write(vt, y)[x], n, cell);
+	magma_vt_damage(vt, y, x, x + n);
+	magma_vt_use(vt, y, x + n);
+}
+
+int magma_vt_take_moves(magma_vt_t *vt, const magma_vt_move_t **moves) {
+	int n = vt->n_moves;
+
+	*moves = vt->moves;
+	vt->n_moves = 0;
+
+	return n > MAGMA_VT_MAX_MOVES ? -1 : n;
+}
+
+bool magma_vt_take_damage(magma_vt_t *vt, int y, int *x0, int *x1) {
+	magma_vt_row_t *row = magma_vt_row(vt, y);
+
+	*x0 = row->damage_x0;
+	*x1 = row->damage_x1;
+	row->damage_x0 = 0;
+	row->damage_x1 = 0;
+
+	return *x0 < *x1;
+}
+
+void magma_vt_damage_all(magma_vt_t *vt) {
+	vt->n_moves = MAGMA_VT_MAX_MOVES + 1;
+	vt->dirty = true;
+}
+
+/*a row of the old screen or one taken back from the scrollback*/
+typedef struct {
+	const glyph_t *cells;
+	int len;
+	bool wrapped;
+} grid_piece_t;
+
+/*number of pieces from first that make up one line, and its length*/
+static int grid_line(const grid_piece_t *pieces, int first, int n_pieces, int *len) {
+	int i = first;
+
+	*len = 0;
+	do {
+		*len += pieces[i].len;
+	} while(pieces[i++].wrapped && i < n_pieces);
+
+	return i - first;
+}
+
+/*the cell at offset of the line made of n pieces*/
+static const glyph_t *grid_line_cell(const grid_piece_t *pieces, int n, int offset) {
+	for(int i = 0; i < n; i++) {
+		if(offset < pieces[i].len) {
+			return &pieces[i].cells[offset];
+		}
+		offset -= pieces[i].len;
+	}
+	return NULL;
+}
+
+/* end of the row starting at offset of a line len cells long,
+ * one column early when the cut would split a wide character,
+ * as magma_vt_print wraps it
+ */
+static int grid_line_cut(const grid_piece_t *pieces, int n, int len, int offset, int cols) {
+	int end = offset + cols;
+
+	if(end >= len) {
+		return len;
+	}
+	if(cols > 1 && grid_line_cell(pieces, n, end - 1)->flags & MAGMA_GLYPH_WIDE) {
+		end--;
+	}
+	return end;
+}
+
+/*copy cols cells from offset on of the line made of n pieces*/
+static void grid_line_copy(const grid_piece_t *pieces, int n, int offset, glyph_t *out, int cols) {
+	int x = 0, len;
+
+	for(int i = 0; i < n && x < cols; i++) {
+		if(offset >= pieces[i].len) {
+			offset -= pieces[i].len;
+			continue;
+		}
+
+		len = pieces[i].len - offset < cols - x ? pieces[i].len - offset : cols - x;
+		memcpy(&out[x], &pieces[i].cells[offset], len * sizeof(glyph_t));
+		x += len;
+		offset = 0;
+	}
+}
+
+/* Rewrap the screen to a new width. Rows that wrapped are joined
+ * back into their lines, including the start of a line that
+ * already scrolled off, and cut again at cols. What doesn't fit
+ * goes to the scrollback, the scrollback itself is only rewrapped
+ * once it is looked at
+ */
+static int grid_reflow(magma_vt_t *vt, int rows, int cols) {
+	magma_sb_row_t *taken = NULL;
+	magma_vt_grid_t *grid;
+	grid_piece_t *pieces;
+	glyph_t *spill;
+	line_t line;
+	int n_taken = 0, n_pieces, last, cursor, total = 0, skip;
+	int cursor_y = 0, cursor_x = 0, at = 0, len, used, n, r, y, start, end;
+	bool wrapped, has_cursor;
+
+	grid = magma_vt_grid_alloc(rows, cols);
+	if(!grid) {
+		goto err_grid;
+	}
+
+	spill = malloc(cols * sizeof(glyph_t));
+	if(!spill) {
+		magma_log_error("Failed to allocate reflow row\n");
+		goto err_spill;
+	}
+
+	if(vt->scrollback) {
+		n_taken = magma_scrollback_unwrap(vt->scrollback, &taken);
+		n_taken = n_taken < 0 ? 0 : n_taken;
+	}
+
+	/*blank rows below the cursor are dropped, not pushed up*/
+	for(last = vt->rows - 1; last > vt->buf_y; last--) {
+		if(magma_vt_row(vt, last)->used ||
+				magma_vt_row(vt, last)->flags & MAGMA_ROW_WRAPPED) {
+			break;
+		}
+	}
+
+	n_pieces = n_taken + last + 1;
+	pieces = malloc(n_pieces * sizeof(*pieces));
+	if(!pieces) {
+		magma_log_error("Failed to allocate reflow lines\n");
+		goto err_pieces;
+	}
+
+	for(int i = 0; i < n_taken; i++) {
+		pieces[i] = (grid_piece_t){ taken[i].cells, taken[i].len, true };
+	}
+	for(y = 0; y <= last; y++) {
+		line = magma_vt_line(vt, y);
+		wrapped = magma_vt_row(vt, y)->flags & MAGMA_ROW_WRAPPED;
+		len = wrapped ? vt->cols : grid_used(line, magma_vt_row(vt, y)->used);
+		pieces[n_taken + y] = (grid_piece_t){ line, len, wrapped };
+	}
+	cursor = n_taken + vt->buf_y;
+
+	/*a wide character that didn't fit left an empty last column behind*/
+	for(int i = 0; i + 1 < n_pieces; i++) {
+		if(pieces[i].wrapped && pieces[i].len > 1 && pieces[i + 1].len &&
+				grid_is_zero(pieces[i].cells[pieces[i].len - 1]) &&
+				pieces[i + 1].cells[0].flags & MAGMA_GLYPH_WIDE) {
+			pieces[i].len--;
+		}
+	}
+
+	/*count the rows at the new width and find the cursor's*/
+	for(int i = 0; i < n_pieces; i += n) {
+		n = grid_line(pieces, i, n_pieces, &len);
+
+		has_cursor = cursor >= i && cursor < i + n;
+		if(has_cursor) {
+			at = vt->buf_x;
+			for(int j = i; j < cursor; j++) {
+				at += pieces[j].len;
+			}
+		}
+
+		/*past the end of the text the cursor keeps its column*/
+		r = 0;
+		start = 0;
+		do {
+			end = grid_line_cut(&pieces[i], n, len, start, cols);
+			if(has_cursor && (at < end || end >= len)) {
+				cursor_y = total + r;
+				cursor_x = at - start < cols ? at - start : cols - 1;
+				has_cursor = false;
+			}
+			start = end;
+			r++;
+		} while(start < len);
+
+		total += r;
+	}
+
+	/*keep the bottom on screen unless that loses the cursor*/
+	skip = total > rows ? total - rows : 0;
+	if(skip > cursor_y) {
+		skip = cursor_y;
+	}
+
+	if(vt->scrollback) {
+		magma_scrollback_set_cols(vt->scrollback, cols);
+	}
+
+	r = 0;
+	for(int i = 0; i < n_pieces && r < skip + rows; i += n) {
+		n = grid_line(pieces, i, n_pieces, &used);
+
+		start = 0;
+		do {
+			end = grid_line_cut(&pieces[i], n, used, start, cols);
+			wrapped = end < used;
+			if(r < skip) {
+				/*without a history the rows pushed off are lost*/
+				if(vt->scrollback) {
+					memset(spill, 0, cols * sizeof(glyph_t));
+					grid_line_copy(&pieces[i], n, start, spill, end - start);
+					magma_scrollback_push(vt->scrollback, spill, wrapped ? end - start : cols, wrapped);
+				}
+			} else {
+				/*rows with nothing on them stay on the blank row*/
+				if(start < used) {
+					grid->lines[r - skip] = magma_vt_grid_take(grid);
+					grid_line_copy(&pieces[i], n, start, grid->lines[r - skip], end - start);
+					grid->meta[r - skip].used = end - start;
+				}
+				grid->meta[r - skip].flags = wrapped ? MAGMA_ROW_WRAPPED : 0;
+			}
+			start = end;
+			r++;
+		} while(start < used && r < skip + rows);
+	}
+
+	free(pieces);
+	for(int i = 0; i < n_taken; i++) {
+		free(taken[i].cells);
+	}
+	free(taken);
+	free(spill);
+
+	grid->saved = vt->grid->saved;
+	magma_vt_grid_free(vt->grid);
+	vt->grid = grid;
+
+	vt->buf_y = cursor_y - skip;
+	vt->buf_x = cursor_x;
+	return 0;
+
+err_pieces:
+	/*put the taken rows back where they were*/
+	for(int i = 0; i < n_taken; i++) {
+		magma_scrollback_push(vt->scrollback, taken[i].cells, taken[i].len, true);
+		free(taken[i].cells);
+	}
+	free(taken);
+	free(spill);
+err_spill:
+	magma_vt_grid_free(grid);
+err_grid:
+	return -1;
+}
+
+/*resize the grid shown, vt->rows and vt->cols are still the old size*/
+static int grid_resize_screen(magma_vt_t *vt, int rows, int cols) {
+	magma_vt_grid_t *grid;
+	magma_vt_row_t *row;
+	line_t line;
+	int drop = 0, copy_rows, copy_cols;
+
+	/*full screen programs redraw the alternate screen themselves*/
+	if(cols != vt->cols && !(vt->modes & MAGMA_VT_MODE_ALT)) {
+		return grid_reflow(vt, rows, cols);
+	}
+
+	grid = magma_vt_grid_alloc(rows, cols);
+	if(!grid) {
+		return -1;
+	}
+
+	/*keep the cursor row on screen*/
+	if(vt->buf_y >= rows) {
+		drop = vt->buf_y - rows + 1;
+	}
+
+	copy_rows = vt->rows - drop < rows ? vt->rows - drop : rows;
+	copy_cols = vt->cols < cols ? vt->cols : cols;
+
+	grid_save(vt, 0, drop);
+
+	/*straighten the ring out while copying, blank rows stay shared*/
+	for(int y = 0; y < copy_rows; y++) {
+		line = magma_vt_line(vt, y + drop);
+		row = magma_vt_row(vt, y + drop);
+		if(line != vt->grid->blank) {
+			grid->lines[y] = magma_vt_grid_take(grid);
+			memcpy(grid->lines[y], line, copy_cols * sizeof(glyph_t));
+			grid->meta[y].used = row->used < copy_cols ? row->used : copy_cols;
+		}
+		grid->meta[y].flags = row->flags;
+	}
+
+	grid->saved = vt->grid->saved;
+	magma_vt_grid_free(vt->grid);
+	vt->grid = grid;
+
+	vt->buf_y -= drop;
+	if(vt->buf_x >= cols) {
+		vt->buf_x = cols - 1;
+	}
+
+	return 0;
+}
+
+/* the primary screen behind the alternate one is resized
+ * around the cursor it saved when it was left
+ */
+static int grid_resize_hidden(magma_vt_t *vt, int rows, int cols) {
+	magma_vt_grid_t *alt = vt->grid;
+	int x = vt->buf_x, y = vt->buf_y, ret;
+
+	vt->grid = vt->other;
+	vt->modes &= ~MAGMA_VT_MODE_ALT;
+	vt->buf_x = vt->grid->saved.x < vt->cols ? vt->grid->saved.x : vt->cols - 1;
+	vt->buf_y = vt->grid->saved.y < vt->rows ? vt->grid->saved.y : vt->rows - 1;
+
+	ret = grid_resize_screen(vt, rows, cols);
+
+	vt->grid->saved.x = vt->buf_x;
+	vt->grid->saved.y = vt->buf_y;
+	vt->other = vt->grid;
+	vt->grid = alt;
+	vt->modes |= MAGMA_VT_MODE_ALT;
+	vt->buf_x = x;
+	vt->buf_y = y;
+
+	return ret;
+}
+
+int magma_vt_resize(magma_vt_t *vt, int rows, int cols) {
+	bool *tabs;
+
+	if(rows == vt->rows && cols == vt->cols) {
+		return 0;
+	}
+
+	/*new columns get the default stops, the old ones are kept*/
+	if(cols > vt->cols) {
+		tabs = realloc(vt->tabs, cols * sizeof(bool));
+		if(!tabs) {
+			magma_log_error("Failed to allocate %d tab stops\n", cols);
+			return -1;
+		}
+		for(int x = vt->cols; x < cols; x++) {
+			tabs[x] = x % MAGMA_VT_TAB_WIDTH == 0;
+		}
+		vt->tabs = tabs;
+	}
+
+	/*the history is shown from the bottom again at the new size*/
+	vt->view = 0;
+	vt->wrap_pending = false;
+
+	if(vt->modes & MAGMA_VT_MODE_ALT) {
+		if(grid_resize_hidden(vt, rows, cols) < 0) {
+			return -1;
+		}
+
+		/*the primary screen is already the new size, give up the alternate one*/
+		if(grid_resize_screen(vt, rows, cols) < 0) {
+			magma_vt_grid_free(vt->grid);
+			vt->grid = vt->other;
+			vt->other = NULL;
+			vt->modes &= ~MAGMA_VT_MODE_ALT;
+			vt->buf_x = vt->grid->saved.x;
+			vt->buf_y = vt->grid->saved.y;
+		}
+	} else {
+		/*a hidden alternate screen is cleared before it is shown again anyway*/
+		magma_vt_grid_free(vt->other);
+		vt->other = NULL;
+
+		if(grid_resize_screen(vt, rows, cols) < 0) {
+			return -1;
+		}
+	}
+
+	vt->rows = rows;
+	vt->cols = cols;
+	vt->scroll_top = 0;
+	vt->scroll_bottom = rows - 1;
+	/*everything has to be redrawn after a resize*/
+	magma_vt_damage_all(vt);
+
+	return 0;
+}
+
+void magma_vt_screen_swap(magma_vt_t *vt) {
+	magma_vt_grid_t *grid = vt->grid;
+
+	vt->grid = vt->other;
+	vt->other = grid;
+	vt->modes ^= MAGMA_VT_MODE_ALT;
+
+	/*the history belongs to the primary screen*/
+	vt->view = 0;
+	magma_vt_damage_all(vt);
+}
+
+line_t magma_vt_view_line(magma_vt_t *vt, int y, glyph_t *scratch, int *used) {
+	if((size_t)y >= vt->view) {
+		*used = magma_vt_row(vt, y - vt->view)->used;
+		return magma_vt_line(vt, y - vt->view);
+	}
+
+	*used = magma_scrollback_get(vt, vt->view - 1 - y, scratch, vt->cols);
+	if(*used < 0) {
+		*used = 0;
+	}
+	return scratch;
+}
+
+void magma_vt_scroll_view(magma_vt_t *vt, long delta) {
+	size_t view = vt->view, lines = 0;
+
+	/*only rewrap as much history as the view reaches*/
+	if(vt->scrollback && !(vt->modes & MAGMA_VT_MODE_ALT)) {
+		lines = magma_scrollback_lines(vt->scrollback, delta > 0 ? view + delta : view);
+	}
+
+	if(delta < 0 && (size_t)-delta > vt->view) {
+		vt->view = 0;
+	} else if(delta > 0 && vt->view + delta > lines) {
+		vt->view = lines;
+	} else {
+		vt->view += delta;
+	}
+
+	if(vt->view != view) {
+		magma_vt_damage_all(vt);
+	}
+}
+
+void magma_vt_set_scrollback(magma_vt_t *vt, size_t budget) {
+	if(vt->scrollback) {
+		magma_scrollback_set_budget(vt->scrollback, budget);
+		magma_vt_scroll_view(vt, 0);
+	}
+}
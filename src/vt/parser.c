@@ -0,0 +1,346 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+/* Table driven parser for the DEC VT500 family of escape sequences
+ * based on the state diagram by Paul Williams https://vt100.net/emu/dec_ansi_parser
+ *
+ * Every byte costs one lookup into vt_table which gives the action
+ * to run and the state to move to. Entry and exit actions of the
+ * states are run when the state actually changes.
+ */
+
+enum vt_state {
+	VT_STATE_GROUND,
+	VT_STATE_ESCAPE,
+	VT_STATE_ESCAPE_INTERMEDIATE,
+	VT_STATE_CSI_ENTRY,
+	VT_STATE_CSI_PARAM,
+	VT_STATE_CSI_INTERMEDIATE,
+	VT_STATE_CSI_IGNORE,
+	VT_STATE_DCS_ENTRY,
+	VT_STATE_DCS_PARAM,
+	VT_STATE_DCS_INTERMEDIATE,
+	VT_STATE_DCS_PASSTHROUGH,
+	VT_STATE_DCS_IGNORE,
+	VT_STATE_OSC_STRING,
+	VT_STATE_SOS_PM_APC_STRING,
+	VT_STATE_COUNT,
+	/*table entry doesn't change state*/
+	VT_STATE_NONE = 0xf,
+};
+
+enum vt_action {
+	VT_ACTION_NONE,
+	VT_ACTION_PRINT,
+	VT_ACTION_EXECUTE,
+	VT_ACTION_CLEAR,
+	VT_ACTION_COLLECT,
+	VT_ACTION_PARAM,
+	VT_ACTION_ESC_DISPATCH,
+	VT_ACTION_CSI_DISPATCH,
+	VT_ACTION_HOOK,
+	VT_ACTION_PUT,
+	VT_ACTION_UNHOOK,
+	VT_ACTION_OSC_START,
+	VT_ACTION_OSC_PUT,
+	VT_ACTION_OSC_END,
+};
+
+#define VT_ENTRY(action, state) (uint8_t)(((action) << 4) | (state))
+#define VT_ENTRY_ACTION(entry) ((entry) >> 4)
+#define VT_ENTRY_STATE(entry) ((entry) & 0xf)
+
+static uint8_t vt_table[VT_STATE_COUNT][256];
+static bool vt_table_ready;
+
+static void vt_table_range(enum vt_state state, int start, int end, enum vt_action action, enum vt_state next) {
+	for(int i = start; i <= end; i++) {
+		vt_table[state][i] = VT_ENTRY(action, next);
+	}
+}
+
+/*C0 controls that are executed from most states*/
+static void vt_table_c0(enum vt_state state, enum vt_action action) {
+	vt_table_range(state, 0x00, 0x17, action, VT_STATE_NONE);
+	vt_table_range(state, 0x19, 0x19, action, VT_STATE_NONE);
+	vt_table_range(state, 0x1c, 0x1f, action, VT_STATE_NONE);
+}
+
+void magma_vt_parser_init(void) {
+	if(vt_table_ready) {
+		return;
+	}
+
+	for(int state = 0; state < VT_STATE_COUNT; state++) {
+		vt_table_range(state, 0x00, 0xff, VT_ACTION_NONE, VT_STATE_NONE);
+	}
+
+	vt_table_c0(VT_STATE_GROUND, VT_ACTION_EXECUTE);
+	/* bytes above 0x7f are UTF8 and not C1 controls,
+	 * the print action hands them to the UTF8 decoder
+	 */
+	vt_table_range(VT_STATE_GROUND, 0x20, 0x7e, VT_ACTION_PRINT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_GROUND, 0x80, 0xff, VT_ACTION_PRINT, VT_STATE_NONE);
+
+	vt_table_c0(VT_STATE_ESCAPE, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_ESCAPE, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_ESCAPE_INTERMEDIATE);
+	vt_table_range(VT_STATE_ESCAPE, 0x30, 0x7e, VT_ACTION_ESC_DISPATCH, VT_STATE_GROUND);
+	vt_table_range(VT_STATE_ESCAPE, 'P', 'P', VT_ACTION_NONE, VT_STATE_DCS_ENTRY);
+	vt_table_range(VT_STATE_ESCAPE, 'X', 'X', VT_ACTION_NONE, VT_STATE_SOS_PM_APC_STRING);
+	vt_table_range(VT_STATE_ESCAPE, '[', '[', VT_ACTION_NONE, VT_STATE_CSI_ENTRY);
+	vt_table_range(VT_STATE_ESCAPE, ']', ']', VT_ACTION_NONE, VT_STATE_OSC_STRING);
+	vt_table_range(VT_STATE_ESCAPE, '^', '_', VT_ACTION_NONE, VT_STATE_SOS_PM_APC_STRING);
+
+	vt_table_c0(VT_STATE_ESCAPE_INTERMEDIATE, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_ESCAPE_INTERMEDIATE, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_ESCAPE_INTERMEDIATE, 0x30, 0x7e, VT_ACTION_ESC_DISPATCH, VT_STATE_GROUND);
+
+	/* ':' is accepted as a parameter separator so
+	 * SGR sub parameters (38:2::r:g:b) survive
+	 */
+	vt_table_c0(VT_STATE_CSI_ENTRY, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_CSI_ENTRY, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_CSI_INTERMEDIATE);
+	vt_table_range(VT_STATE_CSI_ENTRY, 0x30, 0x3b, VT_ACTION_PARAM, VT_STATE_CSI_PARAM);
+	vt_table_range(VT_STATE_CSI_ENTRY, 0x3c, 0x3f, VT_ACTION_COLLECT, VT_STATE_CSI_PARAM);
+	vt_table_range(VT_STATE_CSI_ENTRY, 0x40, 0x7e, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+	vt_table_c0(VT_STATE_CSI_PARAM, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_CSI_PARAM, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_CSI_INTERMEDIATE);
+	vt_table_range(VT_STATE_CSI_PARAM, 0x30, 0x3b, VT_ACTION_PARAM, VT_STATE_NONE);
+	vt_table_range(VT_STATE_CSI_PARAM, 0x3c, 0x3f, VT_ACTION_NONE, VT_STATE_CSI_IGNORE);
+	vt_table_range(VT_STATE_CSI_PARAM, 0x40, 0x7e, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+	vt_table_c0(VT_STATE_CSI_INTERMEDIATE, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_CSI_INTERMEDIATE, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_CSI_INTERMEDIATE, 0x30, 0x3f, VT_ACTION_NONE, VT_STATE_CSI_IGNORE);
+	vt_table_range(VT_STATE_CSI_INTERMEDIATE, 0x40, 0x7e, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+	vt_table_c0(VT_STATE_CSI_IGNORE, VT_ACTION_EXECUTE);
+	vt_table_range(VT_STATE_CSI_IGNORE, 0x40, 0x7e, VT_ACTION_NONE, VT_STATE_GROUND);
+
+	vt_table_range(VT_STATE_DCS_ENTRY, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_DCS_INTERMEDIATE);
+	vt_table_range(VT_STATE_DCS_ENTRY, 0x30, 0x39, VT_ACTION_PARAM, VT_STATE_DCS_PARAM);
+	vt_table_range(VT_STATE_DCS_ENTRY, ':', ':', VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+	vt_table_range(VT_STATE_DCS_ENTRY, ';', ';', VT_ACTION_PARAM, VT_STATE_DCS_PARAM);
+	vt_table_range(VT_STATE_DCS_ENTRY, 0x3c, 0x3f, VT_ACTION_COLLECT, VT_STATE_DCS_PARAM);
+	vt_table_range(VT_STATE_DCS_ENTRY, 0x40, 0x7e, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+	vt_table_range(VT_STATE_DCS_PARAM, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_DCS_INTERMEDIATE);
+	vt_table_range(VT_STATE_DCS_PARAM, 0x30, 0x39, VT_ACTION_PARAM, VT_STATE_NONE);
+	vt_table_range(VT_STATE_DCS_PARAM, ':', ':', VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+	vt_table_range(VT_STATE_DCS_PARAM, ';', ';', VT_ACTION_PARAM, VT_STATE_NONE);
+	vt_table_range(VT_STATE_DCS_PARAM, 0x3c, 0x3f, VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+	vt_table_range(VT_STATE_DCS_PARAM, 0x40, 0x7e, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+	vt_table_range(VT_STATE_DCS_INTERMEDIATE, 0x20, 0x2f, VT_ACTION_COLLECT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_DCS_INTERMEDIATE, 0x30, 0x3f, VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+	vt_table_range(VT_STATE_DCS_INTERMEDIATE, 0x40, 0x7e, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+	vt_table_c0(VT_STATE_DCS_PASSTHROUGH, VT_ACTION_PUT);
+	vt_table_range(VT_STATE_DCS_PASSTHROUGH, 0x20, 0x7e, VT_ACTION_PUT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_DCS_PASSTHROUGH, 0x80, 0xff, VT_ACTION_PUT, VT_STATE_NONE);
+
+	/* xterm lets BEL terminate an OSC as well as ST,
+	 * UTF8 is allowed in window titles
+	 */
+	vt_table_range(VT_STATE_OSC_STRING, 0x07, 0x07, VT_ACTION_NONE, VT_STATE_GROUND);
+	vt_table_range(VT_STATE_OSC_STRING, 0x20, 0x7f, VT_ACTION_OSC_PUT, VT_STATE_NONE);
+	vt_table_range(VT_STATE_OSC_STRING, 0x80, 0xff, VT_ACTION_OSC_PUT, VT_STATE_NONE);
+
+	/*transitions from anywhere*/
+	for(int state = 0; state < VT_STATE_COUNT; state++) {
+		vt_table[state][0x18] = VT_ENTRY(VT_ACTION_EXECUTE, VT_STATE_GROUND);
+		vt_table[state][0x1a] = VT_ENTRY(VT_ACTION_EXECUTE, VT_STATE_GROUND);
+		vt_table[state][0x1b] = VT_ENTRY(VT_ACTION_NONE, VT_STATE_ESCAPE);
+	}
+
+	vt_table_ready = true;
+}
+
+static void vt_parser_clear(magma_vt_parser_t *parser) {
+	parser->n_intermediates = 0;
+	parser->n_params = 0;
+	parser->subparams = 0;
+}
+
+static void vt_parser_collect(magma_vt_parser_t *parser, uint8_t byte) {
+	if(parser->n_intermediates < MAGMA_VT_MAX_INTERMEDIATES) {
+		parser->intermediates[parser->n_intermediates++] = byte;
+	}
+}
+
+/* n_params is allowed to run one past MAGMA_VT_MAX_PARAMS
+ * to mark that the rest of the parameters are dropped
+ */
+static void vt_parser_param(magma_vt_parser_t *parser, uint8_t byte) {
+	uint32_t value;
+
+	if(parser->n_params == 0) {
+		parser->params[0] = 0;
+		parser->n_params = 1;
+	}
+
+	if(byte == ';' || byte == ':') {
+		if(parser->n_params < MAGMA_VT_MAX_PARAMS) {
+			parser->subparams |= (byte == ':') << parser->n_params;
+			parser->params[parser->n_params] = 0;
+		}
+		if(parser->n_params <= MAGMA_VT_MAX_PARAMS) {
+			parser->n_params++;
+		}
+		return;
+	}
+
+	if(parser->n_params > MAGMA_VT_MAX_PARAMS) {
+		return;
+	}
+
+	value = parser->params[parser->n_params - 1] * 10 + (byte - '0');
+	parser->params[parser->n_params - 1] = value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+/* decode a run of text that isn't plain ASCII,
+ * or finishes a character from the last read
+ */
+static void vt_parser_print_utf8(magma_vt_t *vt, const uint8_t *buf, size_t len) {
+	utf32_t unicode[256];
+	size_t used, n;
+
+	while(len) {
+		used = magma_utf8_decode(&vt->parser.utf8, buf, len,
+				unicode, sizeof(unicode) / sizeof(unicode[0]), &n);
+		for(size_t i = 0; i < n; i++) {
+			magma_vt_print(vt, unicode[i]);
+		}
+
+		buf += used;
+		len -= used;
+	}
+}
+
+static void vt_parser_action(magma_vt_t *vt, enum vt_action action, uint8_t byte) {
+	magma_vt_parser_t *parser = &vt->parser;
+
+	switch(action) {
+		case VT_ACTION_PRINT:
+			vt_parser_print_utf8(vt, &byte, 1);
+			break;
+		case VT_ACTION_EXECUTE:
+			magma_vt_execute(vt, byte);
+			break;
+		case VT_ACTION_CLEAR:
+			vt_parser_clear(parser);
+			break;
+		case VT_ACTION_COLLECT:
+			vt_parser_collect(parser, byte);
+			break;
+		case VT_ACTION_PARAM:
+			vt_parser_param(parser, byte);
+			break;
+		case VT_ACTION_ESC_DISPATCH:
+			magma_vt_esc_dispatch(vt, byte);
+			break;
+		case VT_ACTION_CSI_DISPATCH:
+			if(parser->n_params > MAGMA_VT_MAX_PARAMS) {
+				parser->n_params = MAGMA_VT_MAX_PARAMS;
+			}
+			magma_vt_csi_dispatch(vt, byte);
+			break;
+		case VT_ACTION_OSC_START:
+			parser->osc_len = 0;
+			break;
+		case VT_ACTION_OSC_PUT:
+			/*leave room for the terminator*/
+			if(parser->osc_len < MAGMA_VT_OSC_MAX - 1) {
+				parser->osc[parser->osc_len++] = byte;
+			}
+			break;
+		case VT_ACTION_OSC_END:
+			parser->osc[parser->osc_len] = '\0';
+			magma_vt_osc_dispatch(vt);
+			break;
+		/*DCS strings (sixel, DECRQSS...) are not supported yet*/
+		case VT_ACTION_HOOK:
+		case VT_ACTION_PUT:
+		case VT_ACTION_UNHOOK:
+		case VT_ACTION_NONE:
+			break;
+	}
+}
+
+static void vt_parser_exit(magma_vt_t *vt, enum vt_state state) {
+	if(state == VT_STATE_OSC_STRING) {
+		vt_parser_action(vt, VT_ACTION_OSC_END, 0);
+	} else if(state == VT_STATE_DCS_PASSTHROUGH) {
+		vt_parser_action(vt, VT_ACTION_UNHOOK, 0);
+	}
+}
+
+static void vt_parser_enter(magma_vt_t *vt, enum vt_state state) {
+	switch(state) {
+		case VT_STATE_ESCAPE:
+		case VT_STATE_CSI_ENTRY:
+		case VT_STATE_DCS_ENTRY:
+			vt_parser_action(vt, VT_ACTION_CLEAR, 0);
+			break;
+		case VT_STATE_OSC_STRING:
+			vt_parser_action(vt, VT_ACTION_OSC_START, 0);
+			break;
+		case VT_STATE_DCS_PASSTHROUGH:
+			vt_parser_action(vt, VT_ACTION_HOOK, 0);
+			break;
+		default:
+			break;
+	}
+}
+
+void magma_vt_parser_feed(magma_vt_t *vt, const uint8_t *buf, size_t len) {
+	magma_vt_parser_t *parser = &vt->parser;
+	uint8_t entry, next;
+	size_t run;
+
+	for(size_t i = 0; i < len; i++) {
+		/* plain text is most of what we get, hand whole runs
+		 * of it to the grid instead of going byte by byte
+		 */
+		if(parser->state == VT_STATE_GROUND) {
+			if(parser->utf8.need == 0 && buf[i] >= 0x20 && buf[i] < 0x7f) {
+				run = magma_vt_scan_printable(&buf[i], len - i);
+				magma_vt_print_ascii(vt, &buf[i], run);
+				i += run - 1;
+				continue;
+			}
+
+			if(parser->utf8.need || buf[i] >= 0x80) {
+				run = magma_vt_scan_text(&buf[i], len - i);
+				if(run) {
+					vt_parser_print_utf8(vt, &buf[i], run);
+					i += run - 1;
+					continue;
+				}
+
+				/*a control interrupted a character*/
+				if(magma_utf8_flush(&parser->utf8)) {
+					magma_vt_print(vt, 0xfffd);
+				}
+			}
+		}
+
+		entry = vt_table[parser->state][buf[i]];
+		next = VT_ENTRY_STATE(entry);
+
+		if(next == VT_STATE_NONE) {
+			vt_parser_action(vt, VT_ENTRY_ACTION(entry), buf[i]);
+			continue;
+		}
+
+		vt_parser_exit(vt, parser->state);
+		vt_parser_action(vt, VT_ENTRY_ACTION(entry), buf[i]);
+		parser->state = next;
+		vt_parser_enter(vt, next);
+	}
+}
@@ -0,0 +1,226 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <magma/logger/log.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+static int reader_pipe(int fds[2]) {
+	if(pipe(fds) < 0) {
+		magma_log_error("pipe: %m\n");
+		return -1;
+	}
+
+	for(int i = 0; i < 2; i++) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	return 0;
+}
+
+static void reader_drain(int fd) {
+	uint8_t discard[64];
+	while(read(fd, discard, sizeof(discard)) > 0);
+}
+
+static void reader_signal(int fd) {
+	uint8_t byte = 0;
+	/*a full pipe already means the other side will wake*/
+	while(write(fd, &byte, 1) < 0 && errno == EINTR);
+}
+
+/*only write to the pipe when the main thread hasn't already been told*/
+static void reader_notify(struct magma_vt_reader *reader) {
+	if(!atomic_exchange(&reader->notified, true)) {
+		reader_signal(reader->notify[1]);
+	}
+}
+
+static void *reader_thread(void *data) {
+	struct magma_vt_reader *reader = data;
+	struct pollfd pfds[2];
+	uint8_t *ptr;
+	size_t space;
+	ssize_t ret;
+
+	pfds[0].fd = reader->wake[0];
+	pfds[0].events = POLLIN;
+
+	while(atomic_load(&reader->running)) {
+		space = magma_ring_write_ptr(&reader->ring, &ptr);
+
+		/* with the ring full stop polling the master, the child
+		 * blocks on the pty until the parser catches up
+		 */
+		if(space == 0) {
+			atomic_store(&reader->full, true);
+			atomic_thread_fence(memory_order_seq_cst);
+			space = magma_ring_write_ptr(&reader->ring, &ptr);
+		}
+		if(space) {
+			atomic_store(&reader->full, false);
+		}
+		/*a negative fd is skipped by poll, even for POLLHUP*/
+		pfds[1].fd = space ? reader->master : -1;
+		pfds[1].events = POLLIN;
+
+		if(poll(pfds, 2, -1) < 0) {
+			if(errno == EINTR) continue;
+			magma_log_error("poll: %m\n");
+			break;
+		}
+
+		if(pfds[0].revents & POLLIN) {
+			reader_drain(reader->wake[0]);
+		}
+
+		if(space == 0 || !(pfds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		ret = read(reader->master, ptr, space);
+		if(ret > 0) {
+			magma_ring_commit(&reader->ring, ret);
+			reader_notify(reader);
+		} else if(ret == 0 || (errno != EAGAIN && errno != EINTR)) {
+			if(ret < 0 && errno != EIO) {
+				magma_log_error("read: %m\n");
+			}
+			break;
+		}
+	}
+
+	atomic_store(&reader->hangup, true);
+	reader_signal(reader->notify[1]);
+	return NULL;
+}
+
+int magma_vt_reader_start(magma_vt_t *vt) {
+	struct magma_vt_reader *reader;
+
+	reader = calloc(1, sizeof(*reader));
+	if(!reader) {
+		magma_log_error("Failed to allocate reader\n");
+		goto err_alloc;
+	}
+
+	if(magma_ring_init(&reader->ring, MAGMA_VT_RING_SIZE) < 0) {
+		goto err_ring;
+	}
+
+	if(reader_pipe(reader->wake) < 0) {
+		goto err_wake;
+	}
+
+	if(reader_pipe(reader->notify) < 0) {
+		goto err_notify;
+	}
+
+	reader->master = vt->master;
+	atomic_init(&reader->running, true);
+	atomic_init(&reader->hangup, false);
+	atomic_init(&reader->full, false);
+	atomic_init(&reader->notified, false);
+
+	if(pthread_create(&reader->thread, NULL, reader_thread, reader)) {
+		magma_log_error("Failed to create pty reader thread\n");
+		goto err_thread;
+	}
+
+	vt->reader = reader;
+	return 0;
+
+err_thread:
+	close(reader->notify[0]);
+	close(reader->notify[1]);
+err_notify:
+	close(reader->wake[0]);
+	close(reader->wake[1]);
+err_wake:
+	magma_ring_deinit(&reader->ring);
+err_ring:
+	free(reader);
+err_alloc:
+	return -1;
+}
+
+void magma_vt_reader_stop(magma_vt_t *vt) {
+	struct magma_vt_reader *reader = vt->reader;
+
+	if(!reader) {
+		return;
+	}
+
+	atomic_store(&reader->running, false);
+	reader_signal(reader->wake[1]);
+	pthread_join(reader->thread, NULL);
+
+	close(reader->notify[0]);
+	close(reader->notify[1]);
+	close(reader->wake[0]);
+	close(reader->wake[1]);
+	magma_ring_deinit(&reader->ring);
+	free(reader);
+
+	vt->reader = NULL;
+}
+
+ssize_t magma_vt_reader_consume(magma_vt_t *vt) {
+	struct magma_vt_reader *reader = vt->reader;
+	const uint8_t *ptr;
+	size_t total = 0, avail;
+	bool hangup;
+
+	/* clear the flag before looking at the ring, anything
+	 * committed after this point notifies again
+	 */
+	reader_drain(reader->notify[0]);
+	atomic_store(&reader->notified, false);
+	hangup = atomic_load(&reader->hangup);
+
+	while(total < MAGMA_VT_READ_MAX) {
+		avail = magma_ring_read_ptr(&reader->ring, &ptr);
+		if(avail == 0) {
+			break;
+		}
+
+		if(avail > MAGMA_VT_READ_MAX - total) {
+			avail = MAGMA_VT_READ_MAX - total;
+		}
+
+		magma_vt_parse(vt, ptr, avail);
+		magma_ring_release(&reader->ring, avail);
+		total += avail;
+	}
+
+	/*pairs with the fence in reader_thread*/
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load(&reader->full)) {
+		reader_signal(reader->wake[1]);
+	}
+
+	/*come back for the rest on the next loop*/
+	if(magma_ring_used(&reader->ring)) {
+		reader_notify(reader);
+	} else if(hangup) {
+		return -1;
+	}
+
+	return total;
+}
+
+int magma_vt_get_fd(magma_vt_t *vt) {
+	if(vt->reader) {
+		return vt->reader->notify[0];
+	}
+
+	return vt->master;
+}
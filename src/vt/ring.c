@@ -0,0 +1,84 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <magma/logger/log.h>
+#include <magma/private/vt.h>
+
+/* Single producer single consumer byte ring.
+ *
+ * head and tail only ever grow and are masked on access,
+ * head is only written by the producer and tail only by the
+ * consumer so neither side needs a lock. The acquire/release
+ * pairs make sure the bytes are visible before the index that
+ * publishes them.
+ */
+
+int magma_ring_init(magma_ring_t *ring, size_t size) {
+	/*size has to be a power of two for the masking to work*/
+	if(size == 0 || (size & (size - 1))) {
+		magma_log_error("Ring size %zu is not a power of two\n", size);
+		return -1;
+	}
+
+	ring->buf = malloc(size);
+	if(!ring->buf) {
+		magma_log_error("Failed to allocate %zu byte ring\n", size);
+		return -1;
+	}
+
+	ring->size = size;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return 0;
+}
+
+void magma_ring_deinit(magma_ring_t *ring) {
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+size_t magma_ring_write_ptr(magma_ring_t *ring, uint8_t **ptr) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	size_t offset = head & (ring->size - 1);
+	size_t space = ring->size - (head - tail);
+
+	/*only hand out the part before the wrap*/
+	if(space > ring->size - offset) {
+		space = ring->size - offset;
+	}
+
+	*ptr = &ring->buf[offset];
+	return space;
+}
+
+void magma_ring_commit(magma_ring_t *ring, size_t len) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	atomic_store_explicit(&ring->head, head + len, memory_order_release);
+}
+
+size_t magma_ring_read_ptr(magma_ring_t *ring, const uint8_t **ptr) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	size_t offset = tail & (ring->size - 1);
+	size_t avail = head - tail;
+
+	if(avail > ring->size - offset) {
+		avail = ring->size - offset;
+	}
+
+	*ptr = &ring->buf[offset];
+	return avail;
+}
+
+void magma_ring_release(magma_ring_t *ring, size_t len) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
+
+size_t magma_ring_used(magma_ring_t *ring) {
+	return atomic_load_explicit(&ring->head, memory_order_acquire) -
+		atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
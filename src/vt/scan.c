@@ -0,0 +1,103 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <magma/private/vt.h>
+
+/* A byte ends a printable run if it is a C0 control, DEL,
+ * or has the high bit set (part of a UTF8 sequence).
+ * The vector paths compare as signed bytes, everything >= 0x80
+ * is negative so a single "less than 0x20" covers C0 and UTF8.
+ */
+static inline int vt_scan_is_printable(uint8_t byte) {
+	return byte >= 0x20 && byte < 0x7f;
+}
+
+size_t magma_vt_scan_printable(const uint8_t *buf, size_t len) {
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i space32 = _mm256_set1_epi8(0x20);
+	const __m256i del32 = _mm256_set1_epi8(0x7f);
+
+	for(; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)&buf[i]);
+		__m256i stop = _mm256_or_si256(_mm256_cmpgt_epi8(space32, chunk),
+				_mm256_cmpeq_epi8(chunk, del32));
+		uint32_t mask = _mm256_movemask_epi8(stop);
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i del = _mm_set1_epi8(0x7f);
+
+	for(; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)&buf[i]);
+		__m128i stop = _mm_or_si128(_mm_cmplt_epi8(chunk, space),
+				_mm_cmpeq_epi8(chunk, del));
+		uint32_t mask = _mm_movemask_epi8(stop);
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	for(; i < len; i++) {
+		if(!vt_scan_is_printable(buf[i])) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+size_t magma_vt_scan_text(const uint8_t *buf, size_t len) {
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i c0_mask32 = _mm256_set1_epi8((char)0xe0);
+	const __m256i del32 = _mm256_set1_epi8(0x7f);
+
+	for(; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)&buf[i]);
+		__m256i stop = _mm256_or_si256(
+				_mm256_cmpeq_epi8(_mm256_and_si256(chunk, c0_mask32), _mm256_setzero_si256()),
+				_mm256_cmpeq_epi8(chunk, del32));
+		uint32_t mask = _mm256_movemask_epi8(stop);
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i c0_mask = _mm_set1_epi8((char)0xe0);
+	const __m128i del = _mm_set1_epi8(0x7f);
+
+	for(; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)&buf[i]);
+		__m128i stop = _mm_or_si128(
+				_mm_cmpeq_epi8(_mm_and_si128(chunk, c0_mask), _mm_setzero_si128()),
+				_mm_cmpeq_epi8(chunk, del));
+		uint32_t mask = _mm_movemask_epi8(stop);
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	for(; i < len; i++) {
+		if(buf[i] < 0x20 || buf[i] == 0x7f) {
+			break;
+		}
+	}
+
+	return i;
+}
@@ -0,0 +1,813 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magma/logger/log.h>
+#include <magma/unicode.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+/* Scrollback history.
+ *
+ * Rows are pushed as cells into a small ring so the lines just
+ * above the screen are cheap to show. When the ring is full the
+ * oldest row is packed: cells with the same attributes and colors
+ * are stored once as a run and the code points as UTF8, a plain
+ * ASCII row costs about one byte per column. Clusters are stored
+ * as their code points, once no cell on the grid refers to one
+ * anymore its id goes back to the table.
+ *
+ * Rows are kept at the width they were pushed with. After the
+ * width changes the older rows are joined back into the lines
+ * they wrapped from and cut at the new width, but only going back
+ * as far as the view has been, a resize costs the same with a
+ * short or a long history.
+ */
+
+/*a LEB128 uint32 takes at most 5 bytes*/
+#define SB_VARINT_MAX 5
+/*worst case run: length, attributes, fg and bg*/
+#define SB_RUN_MAX (4 * SB_VARINT_MAX)
+/*can't start UTF8, a cluster follows*/
+#define SB_CLUSTER 0xff
+
+static const glyph_t sb_blank;
+
+static inline uint8_t *sb_put_varint(uint8_t *p, uint32_t value) {
+	while(value >= 0x80) {
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+static inline const uint8_t *sb_get_varint(const uint8_t *p, uint32_t *value) {
+	uint32_t v = 0;
+	int shift = 0;
+
+	do {
+		v |= (uint32_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while(*p++ & 0x80);
+
+	*value = v;
+	return p;
+}
+
+static inline uint8_t *sb_put_utf8(uint8_t *p, utf32_t c) {
+	if(c < 0x80) {
+		*p++ = c;
+	} else if(c < 0x800) {
+		*p++ = 0xc0 | (c >> 6);
+		*p++ = 0x80 | (c & 0x3f);
+	} else if(c < 0x10000) {
+		*p++ = 0xe0 | (c >> 12);
+		*p++ = 0x80 | ((c >> 6) & 0x3f);
+		*p++ = 0x80 | (c & 0x3f);
+	} else {
+		*p++ = 0xf0 | (c >> 18);
+		*p++ = 0x80 | ((c >> 12) & 0x3f);
+		*p++ = 0x80 | ((c >> 6) & 0x3f);
+		*p++ = 0x80 | (c & 0x3f);
+	}
+	return p;
+}
+
+/*only ever decodes what sb_put_utf8 wrote*/
+static inline const uint8_t *sb_get_utf8(const uint8_t *p, utf32_t *c) {
+	if(p[0] < 0x80) {
+		*c = p[0];
+		return p + 1;
+	} else if(p[0] < 0xe0) {
+		*c = (p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+		return p + 2;
+	} else if(p[0] < 0xf0) {
+		*c = (p[0] & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+		return p + 3;
+	}
+
+	*c = (p[0] & 0x07) << 18 | (p[1] & 0x3f) << 12 | (p[2] & 0x3f) << 6 | (p[3] & 0x3f);
+	return p + 4;
+}
+
+/*trailing blank cells are not stored*/
+static int sb_trim(const glyph_t *cells, int cols) {
+	const glyph_t *cell;
+
+	for(; cols > 0; cols--) {
+		cell = &cells[cols - 1];
+		if(cell->unicode | cell->style | cell->flags) {
+			break;
+		}
+	}
+	return cols;
+}
+
+static uint8_t *sb_scratch(magma_scrollback_t *sb, size_t size) {
+	uint8_t *scratch;
+
+	if(size > sb->scratch_size) {
+		scratch = realloc(sb->scratch, size);
+		if(!scratch) {
+			magma_log_error("Failed to allocate %zu byte scrollback buffer\n", size);
+			return NULL;
+		}
+		sb->scratch = scratch;
+		sb->scratch_size = size;
+	}
+
+	return sb->scratch;
+}
+
+/*returns the packed size of the row, the row is left in sb->scratch*/
+static size_t sb_encode(magma_scrollback_t *sb, const glyph_t *cells, int len, bool wrapped) {
+	const magma_cluster_t *cluster;
+	const magma_style_t *style;
+	uint8_t *start, *p;
+	size_t used;
+	int run;
+
+	/*header plus a run and 4 bytes of UTF8 per cell at most*/
+	start = sb_scratch(sb, 2 * SB_VARINT_MAX + (size_t)len * (SB_RUN_MAX + 4));
+	if(!start) {
+		return 0;
+	}
+
+	/*the byte size goes in front once it is known*/
+	p = start + SB_VARINT_MAX;
+	p = sb_put_varint(p, (uint32_t)len << 1 | wrapped);
+
+	/*style indices don't outlive the table, store what they point at*/
+	for(int x = 0; x < len; x += run) {
+		for(run = 1; x + run < len && cells[x].style == cells[x + run].style; run++);
+		style = &sb->styles->entries[cells[x].style];
+		p = sb_put_varint(p, run);
+		p = sb_put_varint(p, style->attributes);
+		p = sb_put_varint(p, style->fg);
+		p = sb_put_varint(p, style->bg);
+	}
+
+	for(int x = 0; x < len; x++) {
+		if(!(cells[x].unicode & MAGMA_GLYPH_CLUSTER)) {
+			p = sb_put_utf8(p, cells[x].unicode);
+			continue;
+		}
+
+		/*the scratch only has room for one code point per cell*/
+		cluster = &sb->clusters->entries[cells[x].unicode & ~MAGMA_GLYPH_CLUSTER];
+		used = p - start;
+		start = sb_scratch(sb, used + 1 + SB_VARINT_MAX + ((size_t)cluster->len + len - x) * 4);
+		if(!start) {
+			return 0;
+		}
+		p = start + used;
+
+		*p++ = SB_CLUSTER;
+		p = sb_put_varint(p, cluster->len);
+		for(uint32_t i = 0; i < cluster->len; i++) {
+			p = sb_put_utf8(p, sb->clusters->data[cluster->offset + i]);
+		}
+	}
+
+	return p - (start + SB_VARINT_MAX);
+}
+
+/* decode cells skip to skip + n of a packed row into base
+ * from at on, cells past the end of the row are blank
+ */
+static void sb_decode(magma_vt_t *vt, const uint8_t *p, glyph_t *base, int at, int skip, int n) {
+	magma_styles_t *styles = &vt->styles;
+	magma_clusters_t *clusters = &vt->clusters;
+	utf32_t cps[MAGMA_CLUSTER_MAX];
+	uint32_t size, len, run, count;
+	magma_style_t style;
+	uint16_t index;
+	utf32_t c;
+	bool tail = false;
+	int x = 0, end = skip + n, width;
+
+	p = sb_get_varint(p, &size);
+	p = sb_get_varint(p, &len);
+	len >>= 1;
+
+	/*styles first, the code points are filled in after*/
+	while(x < (int)len) {
+		p = sb_get_varint(p, &run);
+		p = sb_get_varint(p, &style.attributes);
+		p = sb_get_varint(p, &style.fg);
+		p = sb_get_varint(p, &style.bg);
+
+		if(x < end && x + (int)run > skip) {
+			/*interning can collect, keep the cells already decoded alive*/
+			styles->pinned = base;
+			styles->n_pinned = at + (x > skip ? x - skip : 0);
+			index = magma_styles_intern(vt, &style);
+
+			for(int i = x > skip ? x : skip; i < x + (int)run && i < end; i++) {
+				base[at + i - skip] = (glyph_t){ .style = index };
+			}
+		}
+		x += run;
+	}
+
+	styles->pinned = NULL;
+	styles->n_pinned = 0;
+
+	for(x = 0; x < (int)len && x < end; x++) {
+		if(*p != SB_CLUSTER) {
+			p = sb_get_utf8(p, &c);
+			width = c ? magma_wcwidth(c) : 0;
+		} else {
+			p = sb_get_varint(p + 1, &count);
+			for(uint32_t i = 0; i < count; i++) {
+				p = sb_get_utf8(p, &cps[i < MAGMA_CLUSTER_MAX ? i : MAGMA_CLUSTER_MAX - 1]);
+			}
+			width = magma_wcwidth(cps[0]);
+
+			c = cps[0];
+			if(x >= skip) {
+				/*interning can collect as well*/
+				clusters->pinned = base;
+				clusters->n_pinned = at + x - skip;
+				c = magma_clusters_intern(vt, cps,
+						count < MAGMA_CLUSTER_MAX ? count : MAGMA_CLUSTER_MAX);
+				if(!c) {
+					c = cps[0];
+				}
+			}
+		}
+
+		if(x >= skip) {
+			base[at + x - skip].unicode = c;
+			if(tail) {
+				base[at + x - skip].flags = MAGMA_GLYPH_WIDE_TAIL;
+			} else if(width == 2 && x + 1 < (int)len) {
+				base[at + x - skip].flags = MAGMA_GLYPH_WIDE;
+			}
+		}
+		tail = !tail && width == 2 && x + 1 < (int)len;
+	}
+
+	clusters->pinned = NULL;
+	clusters->n_pinned = 0;
+
+	for(x = (int)len > skip ? (int)len : skip; x < end; x++) {
+		base[at + x - skip] = sb_blank;
+	}
+}
+
+static int sb_pack(magma_scrollback_t *sb, const magma_sb_row_t *row) {
+	magma_sb_block_t *block = sb->newest;
+	uint8_t header[SB_VARINT_MAX];
+	size_t size, header_len, need;
+
+	size = sb_encode(sb, row->cells, row->len, row->wrapped);
+	if(size == 0) {
+		return -1;
+	}
+
+	header_len = sb_put_varint(header, size) - header;
+	need = header_len + size;
+
+	if(!block || block->size - block->used < need) {
+		size = need > MAGMA_SB_BLOCK_SIZE ? need : MAGMA_SB_BLOCK_SIZE;
+		block = malloc(sizeof(*block) + size);
+		if(!block) {
+			magma_log_error("Failed to allocate scrollback block\n");
+			return -1;
+		}
+
+		block->size = size;
+		block->used = 0;
+		block->n_rows = 0;
+		block->next = NULL;
+		block->prev = sb->newest;
+		if(sb->newest) {
+			sb->newest->next = block;
+		} else {
+			sb->oldest = block;
+		}
+		sb->newest = block;
+		sb->used += sizeof(*block) + size;
+	}
+
+	memcpy(&block->data[block->used], header, header_len);
+	memcpy(&block->data[block->used + header_len], sb->scratch + SB_VARINT_MAX, need - header_len);
+	block->used += need;
+	block->n_rows++;
+	sb->n_packed++;
+
+	return 0;
+}
+
+static void sb_drop_oldest_block(magma_scrollback_t *sb) {
+	magma_sb_block_t *block = sb->oldest;
+
+	if(sb->index_block == block) {
+		sb->index_block = NULL;
+	}
+
+	sb->oldest = block->next;
+	if(sb->oldest) {
+		sb->oldest->prev = NULL;
+	} else {
+		sb->newest = NULL;
+	}
+
+	sb->n_packed -= block->n_rows;
+	sb->used -= sizeof(*block) + block->size;
+	free(block);
+}
+
+static inline magma_sb_row_t *sb_recent(magma_scrollback_t *sb, size_t index) {
+	return &sb->recent[(sb->recent_head + index) % MAGMA_SB_RECENT];
+}
+
+static void sb_drop_oldest_recent(magma_scrollback_t *sb) {
+	magma_sb_row_t *row = sb_recent(sb, 0);
+
+	sb->used -= row->len * sizeof(glyph_t);
+	free(row->cells);
+	row->cells = NULL;
+	row->len = 0;
+	row->wrapped = false;
+
+	sb->recent_head = (sb->recent_head + 1) % MAGMA_SB_RECENT;
+	sb->n_recent--;
+}
+
+static inline uint64_t sb_oldest(const magma_scrollback_t *sb) {
+	return sb->pushed - sb->n_packed - sb->n_recent;
+}
+
+/*rows before this were pushed at another width*/
+static inline uint64_t sb_native_start(const magma_scrollback_t *sb) {
+	uint64_t oldest = sb_oldest(sb);
+	return sb->boundary > oldest ? sb->boundary : oldest;
+}
+
+static void sb_trim_budget(magma_scrollback_t *sb) {
+	uint64_t oldest;
+
+	while(sb->used > sb->budget && sb->oldest) {
+		sb_drop_oldest_block(sb);
+	}
+
+	while(sb->used > sb->budget && sb->n_recent) {
+		sb_drop_oldest_recent(sb);
+	}
+
+	/*a line that lost its first rows isn't shown at all*/
+	oldest = sb_oldest(sb);
+	while(sb->n_lines && sb->lines[sb->n_lines - 1].seq < oldest) {
+		sb->n_lines--;
+	}
+	if(sb->n_lines) {
+		sb->walk = sb->lines[sb->n_lines - 1].seq;
+	} else {
+		sb->walk = sb->boundary;
+	}
+}
+
+/*find packed row seq, pos is set to where it is in the block*/
+static const magma_sb_block_t *sb_find(const magma_scrollback_t *sb, uint64_t seq, size_t *pos) {
+	const magma_sb_block_t *block = sb->newest;
+	size_t index = sb->n_packed - 1 - (seq - sb_oldest(sb));
+
+	/*walk back from the newest block, rows are oldest first inside one*/
+	for(; index >= block->n_rows; block = block->prev) {
+		index -= block->n_rows;
+	}
+
+	*pos = block->n_rows - 1 - index;
+	return block;
+}
+
+/*note where every row of block starts, rows can only be skipped forward*/
+static int sb_index_block(magma_scrollback_t *sb, const magma_sb_block_t *block) {
+	uint32_t (*index)[2];
+	const uint8_t *p = block->data, *q;
+	uint32_t size;
+
+	if(sb->index_block == block && sb->index_rows == block->n_rows) {
+		return 0;
+	}
+
+	if(block->n_rows > sb->index_size) {
+		index = realloc(sb->index, block->n_rows * sizeof(*index));
+		if(!index) {
+			magma_log_error("Failed to allocate scrollback index\n");
+			sb->index_block = NULL;
+			return -1;
+		}
+		sb->index = index;
+		sb->index_size = block->n_rows;
+	}
+
+	for(size_t i = 0; i < block->n_rows; i++) {
+		q = sb_get_varint(p, &size);
+		sb->index[i][0] = p - block->data;
+		sb_get_varint(q, &sb->index[i][1]);
+		p = q + size;
+	}
+
+	sb->index_block = block;
+	sb->index_rows = block->n_rows;
+	return 0;
+}
+
+/*cell count and wrapped flag of row seq*/
+static void sb_row_info(magma_scrollback_t *sb, uint64_t seq, uint32_t *len, bool *wrapped) {
+	const magma_sb_block_t *block;
+	const magma_sb_row_t *row;
+	uint64_t recent = sb->pushed - sb->n_recent;
+	size_t pos;
+
+	if(seq >= recent) {
+		row = sb_recent(sb, seq - recent);
+		*len = row->len;
+		*wrapped = row->wrapped;
+		return;
+	}
+
+	block = sb_find(sb, seq, &pos);
+	if(sb_index_block(sb, block) < 0) {
+		*len = 0;
+		*wrapped = false;
+		return;
+	}
+
+	*len = sb->index[pos][1] >> 1;
+	*wrapped = sb->index[pos][1] & 1;
+}
+
+/*copy cells skip to skip + n of row seq to base from at on*/
+static void sb_copy(magma_vt_t *vt, uint64_t seq, glyph_t *base, int at, int skip, int n) {
+	magma_scrollback_t *sb = vt->scrollback;
+	const magma_sb_block_t *block;
+	const magma_sb_row_t *row;
+	uint64_t recent = sb->pushed - sb->n_recent;
+	size_t pos;
+	int len;
+
+	if(seq >= recent) {
+		row = sb_recent(sb, seq - recent);
+		len = row->len - skip;
+		len = len < 0 ? 0 : len < n ? len : n;
+		if(len) {
+			memcpy(&base[at], &row->cells[skip], len * sizeof(glyph_t));
+		}
+		for(int x = len; x < n; x++) {
+			base[at + x] = sb_blank;
+		}
+		return;
+	}
+
+	block = sb_find(sb, seq, &pos);
+	if(sb_index_block(sb, block) < 0) {
+		for(int x = 0; x < n; x++) {
+			base[at + x] = sb_blank;
+		}
+		return;
+	}
+
+	sb_decode(vt, &block->data[sb->index[pos][0]], base, at, skip, n);
+}
+
+/*whether cell x of row seq is the first half of a wide character*/
+static bool sb_wide(magma_scrollback_t *sb, uint64_t seq, uint32_t x) {
+	const magma_sb_block_t *block;
+	const magma_sb_row_t *row;
+	const uint8_t *p;
+	uint64_t recent = sb->pushed - sb->n_recent;
+	uint32_t size, len, run, value, count;
+	utf32_t c, first;
+	size_t pos;
+	bool tail = false;
+	int width;
+
+	if(seq >= recent) {
+		row = sb_recent(sb, seq - recent);
+		return (int)x < row->len && row->cells[x].flags & MAGMA_GLYPH_WIDE;
+	}
+
+	block = sb_find(sb, seq, &pos);
+	if(sb_index_block(sb, block) < 0) {
+		return false;
+	}
+
+	p = sb_get_varint(&block->data[sb->index[pos][0]], &size);
+	p = sb_get_varint(p, &len);
+	len >>= 1;
+	if(x + 1 >= len) {
+		return false;
+	}
+
+	/*only the code points matter, the widths come from them*/
+	for(uint32_t i = 0; i < len; i += run) {
+		p = sb_get_varint(p, &run);
+		for(int k = 0; k < 3; k++) {
+			p = sb_get_varint(p, &value);
+		}
+	}
+
+	for(uint32_t i = 0;; i++) {
+		if(*p != SB_CLUSTER) {
+			p = sb_get_utf8(p, &c);
+			width = c ? magma_wcwidth(c) : 0;
+		} else {
+			p = sb_get_varint(p + 1, &count);
+			for(uint32_t j = 0; j < count; j++) {
+				p = sb_get_utf8(p, j ? &c : &first);
+			}
+			width = magma_wcwidth(first);
+		}
+
+		if(i == x) {
+			return !tail && width == 2;
+		}
+		tail = !tail && width == 2;
+	}
+}
+
+/*rewrap the older rows until there are want lines of them*/
+static size_t sb_reflow(magma_scrollback_t *sb, size_t want) {
+	magma_sb_line_t *lines, swap;
+	uint64_t oldest = sb_oldest(sb), first, seq;
+	uint32_t len, total, base, offset, end;
+	size_t n, size, start;
+	bool wrapped;
+
+	while(sb->n_lines < want && sb->walk > oldest) {
+		first = sb->walk - 1;
+		sb_row_info(sb, first, &total, &wrapped);
+
+		/*the rows before it that wrapped are the same line*/
+		while(first > oldest) {
+			sb_row_info(sb, first - 1, &len, &wrapped);
+			if(!wrapped) {
+				break;
+			}
+			total += len;
+			first--;
+		}
+
+		/*at most one column is lost to a wide character on each*/
+		n = sb->cols > 1 ? sb->cols - 1 : 1;
+		n = total ? (total + n - 1) / n : 1;
+		if(sb->n_lines + n > sb->lines_size) {
+			size = sb->lines_size ? sb->lines_size * 2 : 256;
+			if(size < sb->n_lines + n) {
+				size = sb->n_lines + n;
+			}
+			lines = realloc(sb->lines, size * sizeof(*lines));
+			if(!lines) {
+				magma_log_error("Failed to allocate scrollback lines\n");
+				break;
+			}
+			sb->lines = lines;
+			sb->lines_size = size;
+		}
+
+		/*cut where grid_reflow would, a wide character isn't split*/
+		start = sb->n_lines;
+		seq = first;
+		base = 0;
+		sb_row_info(sb, seq, &len, &wrapped);
+		offset = 0;
+		do {
+			end = offset + sb->cols;
+			if(end >= total) {
+				end = total;
+			} else if(sb->cols > 1) {
+				for(; base + len <= end - 1; seq++) {
+					base += len;
+					sb_row_info(sb, seq + 1, &len, &wrapped);
+				}
+				if(sb_wide(sb, seq, end - 1 - base)) {
+					end--;
+				}
+			}
+			sb->lines[sb->n_lines++] = (magma_sb_line_t){ first, offset, end - offset };
+			offset = end;
+		} while(offset < total);
+
+		/*newest first, so the last piece of the line goes in first*/
+		for(size_t i = start, j = sb->n_lines - 1; i < j; i++, j--) {
+			swap = sb->lines[i];
+			sb->lines[i] = sb->lines[j];
+			sb->lines[j] = swap;
+		}
+		sb->walk = first;
+	}
+
+	return sb->n_lines;
+}
+
+magma_scrollback_t *magma_scrollback_init(size_t budget, int cols, magma_styles_t *styles,
+		magma_clusters_t *clusters) {
+	magma_scrollback_t *sb;
+
+	sb = calloc(1, sizeof(*sb));
+	if(!sb) {
+		magma_log_error("Failed to allocate scrollback\n");
+		return NULL;
+	}
+
+	sb->budget = budget;
+	sb->cols = cols;
+	sb->styles = styles;
+	sb->clusters = clusters;
+	return sb;
+}
+
+void magma_scrollback_deinit(magma_scrollback_t *sb) {
+	while(sb->oldest) {
+		sb_drop_oldest_block(sb);
+	}
+
+	while(sb->n_recent) {
+		sb_drop_oldest_recent(sb);
+	}
+
+	free(sb->index);
+	free(sb->lines);
+	free(sb->scratch);
+	free(sb);
+}
+
+int magma_scrollback_push(magma_scrollback_t *sb, const glyph_t *cells, int cols, bool wrapped) {
+	magma_sb_row_t *row;
+	glyph_t *copy = NULL, *grown;
+	int len;
+
+	if(sb->budget == 0) {
+		return 0;
+	}
+
+	/*trailing blanks of a wrapped row are part of the line*/
+	len = wrapped ? cols : sb_trim(cells, cols);
+
+	/* make room in the ring by packing the oldest row,
+	 * its cells are reused for the new one
+	 */
+	if(sb->n_recent == MAGMA_SB_RECENT) {
+		row = sb_recent(sb, 0);
+		if(sb_pack(sb, row) < 0) {
+			return -1;
+		}
+
+		sb->used -= row->len * sizeof(glyph_t);
+		copy = row->cells;
+		row->cells = NULL;
+		row->len = 0;
+		row->wrapped = false;
+		sb->recent_head = (sb->recent_head + 1) % MAGMA_SB_RECENT;
+		sb->n_recent--;
+	}
+
+	if(len) {
+		grown = realloc(copy, len * sizeof(glyph_t));
+		if(!grown) {
+			magma_log_error("Failed to allocate scrollback row\n");
+			free(copy);
+			return -1;
+		}
+		copy = grown;
+		memcpy(copy, cells, len * sizeof(glyph_t));
+	} else {
+		free(copy);
+		copy = NULL;
+	}
+
+	row = sb_recent(sb, sb->n_recent++);
+	row->cells = copy;
+	row->len = len;
+	row->wrapped = wrapped;
+	sb->used += len * sizeof(glyph_t);
+	sb->pushed++;
+
+	sb_trim_budget(sb);
+	return 0;
+}
+
+int magma_scrollback_unwrap(magma_scrollback_t *sb, magma_sb_row_t **rows) {
+	magma_sb_row_t *row;
+	size_t n = 0;
+
+	*rows = NULL;
+	while(n < sb->n_recent && sb_recent(sb, sb->n_recent - 1 - n)->wrapped) {
+		n++;
+	}
+
+	if(n == 0) {
+		return 0;
+	}
+
+	*rows = malloc(n * sizeof(**rows));
+	if(!*rows) {
+		magma_log_error("Failed to allocate unwrapped rows\n");
+		return -1;
+	}
+
+	for(size_t i = 0; i < n; i++) {
+		row = sb_recent(sb, sb->n_recent - n + i);
+		(*rows)[i] = *row;
+		sb->used -= row->len * sizeof(glyph_t);
+		row->cells = NULL;
+		row->len = 0;
+		row->wrapped = false;
+	}
+
+	sb->n_recent -= n;
+	sb->pushed -= n;
+
+	/*the rewrapped lines may point at the rows taken*/
+	if(sb->boundary > sb->pushed) {
+		sb->boundary = sb->pushed;
+		sb->walk = sb->pushed;
+		sb->n_lines = 0;
+	}
+
+	return n;
+}
+
+void magma_scrollback_set_cols(magma_scrollback_t *sb, int cols) {
+	if(cols == sb->cols) {
+		return;
+	}
+
+	sb->cols = cols;
+	sb->boundary = sb->pushed;
+	sb->walk = sb->pushed;
+	sb->n_lines = 0;
+}
+
+int magma_scrollback_get(magma_vt_t *vt, size_t index, glyph_t *out, int cols) {
+	magma_scrollback_t *sb = vt->scrollback;
+	uint64_t native = sb->pushed - sb_native_start(sb), seq, end;
+	magma_sb_line_t line;
+	uint32_t len;
+	bool wrapped;
+	int x = 0, n;
+
+	/*pushed at this width, one row is one line*/
+	if(index < native) {
+		seq = sb->pushed - 1 - index;
+		sb_copy(vt, seq, out, 0, 0, cols);
+		sb_row_info(sb, seq, &len, &wrapped);
+		return len < (uint32_t)cols ? (int)len : cols;
+	}
+
+	index -= native;
+	if(sb_reflow(sb, index + 1) <= index) {
+		for(; x < cols; x++) {
+			out[x] = sb_blank;
+		}
+		return -1;
+	}
+
+	/*gather the line's piece from the rows it was wrapped over*/
+	line = sb->lines[index];
+	line.len = line.len < (uint32_t)cols ? line.len : (uint32_t)cols;
+	end = sb_native_start(sb);
+	for(seq = line.seq; x < (int)line.len && seq < end; seq++) {
+		sb_row_info(sb, seq, &len, &wrapped);
+		if(line.offset < len) {
+			n = len - line.offset < line.len - x ? (int)(len - line.offset) : (int)line.len - x;
+			sb_copy(vt, seq, out, x, line.offset, n);
+			x += n;
+			line.offset = 0;
+		} else {
+			line.offset -= len;
+		}
+
+		if(!wrapped) {
+			break;
+		}
+	}
+
+	n = x;
+	for(; x < cols; x++) {
+		out[x] = sb_blank;
+	}
+	return n;
+}
+
+size_t magma_scrollback_lines(magma_scrollback_t *sb, size_t want) {
+	size_t native = sb->pushed - sb_native_start(sb);
+
+	if(want <= native) {
+		return native;
+	}
+
+	return native + sb_reflow(sb, want - native);
+}
+
+void magma_scrollback_set_budget(magma_scrollback_t *sb, size_t budget) {
+	sb->budget = budget;
+	sb_trim_budget(sb);
+}
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magma/logger/log.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+/* Style table.
+ *
+ * Cells only store a 16 bit index, the attributes and colors
+ * live here once per distinct combination. The parser interns
+ * the pen when SGR changes it so printing never touches the
+ * table. Once all 65536 indices are taken the ones no cell
+ * refers to anymore are put on a free list.
+ */
+
+#define STYLES_MAX (UINT16_MAX + 1)
+
+static inline uint32_t style_hash(const magma_style_t *style) {
+	uint32_t h = style->attributes * 0x9e3779b1;
+
+	h ^= style->fg + 0x7f4a7c15 + (h << 6) + (h >> 2);
+	h ^= style->bg + 0x165667b1 + (h << 6) + (h >> 2);
+	return h ^ (h >> 15);
+}
+
+static inline bool style_equal(const magma_style_t *a, const magma_style_t *b) {
+	return a->attributes == b->attributes && a->fg == b->fg && a->bg == b->bg;
+}
+
+/*slot holding style, or the empty slot it would go in*/
+static uint32_t styles_find(const magma_styles_t *styles, const magma_style_t *style) {
+	uint32_t slot = style_hash(style) & styles->hash_mask;
+
+	while(styles->hash[slot] && !style_equal(&styles->entries[styles->hash[slot]], style)) {
+		slot = (slot + 1) & styles->hash_mask;
+	}
+
+	return slot;
+}
+
+static int styles_rehash(magma_styles_t *styles, uint32_t size, const uint8_t *live) {
+	uint16_t *hash;
+
+	hash = calloc(size, sizeof(uint16_t));
+	if(!hash) {
+		magma_log_error("Failed to allocate style hash\n");
+		return -1;
+	}
+
+	free(styles->hash);
+	styles->hash = hash;
+	styles->hash_mask = size - 1;
+
+	for(uint32_t i = 1; i < styles->count; i++) {
+		if(!live || live[i]) {
+			styles->hash[styles_find(styles, &styles->entries[i])] = i;
+		}
+	}
+
+	return 0;
+}
+
+static int styles_grow(magma_styles_t *styles) {
+	magma_style_t *entries;
+	uint32_t capacity = styles->capacity * 2;
+
+	if(capacity > STYLES_MAX) {
+		return -1;
+	}
+
+	entries = realloc(styles->entries, capacity * sizeof(magma_style_t));
+	if(!entries) {
+		magma_log_error("Failed to grow style table to %u\n", capacity);
+		return -1;
+	}
+
+	styles->entries = entries;
+	styles->capacity = capacity;
+
+	/*keep the hash at most half full*/
+	return styles_rehash(styles, capacity * 2, NULL);
+}
+
+static void styles_mark(uint8_t *live, const glyph_t *cells, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		live[cells[i].style] = 1;
+	}
+}
+
+/*put every style no cell refers to on the free list*/
+static int styles_collect(magma_vt_t *vt) {
+	magma_styles_t *styles = &vt->styles;
+	magma_scrollback_t *sb = vt->scrollback;
+	const magma_sb_row_t *row;
+	uint8_t *live;
+
+	live = calloc(styles->capacity, 1);
+	if(!live) {
+		magma_log_error("Failed to allocate style marks\n");
+		return -1;
+	}
+
+	live[0] = 1;
+	live[vt->style] = 1;
+	live[vt->grid->saved.style] = 1;
+	styles_mark(live, vt->grid->slab, (size_t)vt->rows * vt->cols);
+	if(vt->other) {
+		live[vt->other->saved.style] = 1;
+		styles_mark(live, vt->other->slab, (size_t)vt->rows * vt->cols);
+	}
+	styles_mark(live, styles->pinned, styles->n_pinned);
+	for(size_t i = 0; sb && i < sb->n_recent; i++) {
+		row = &sb->recent[(sb->recent_head + i) % MAGMA_SB_RECENT];
+		styles_mark(live, row->cells, row->len);
+	}
+
+	styles->n_free = 0;
+	for(uint32_t i = styles->count; i-- > 1;) {
+		if(!live[i]) {
+			styles->free_list[styles->n_free++] = i;
+		}
+	}
+
+	if(styles_rehash(styles, styles->hash_mask + 1, live) < 0) {
+		styles->n_free = 0;
+		free(live);
+		return -1;
+	}
+
+	magma_log_debug("Collected %u of %u styles\n", styles->n_free, styles->count);
+	free(live);
+	return 0;
+}
+
+int magma_styles_init(magma_styles_t *styles) {
+	memset(styles, 0, sizeof(*styles));
+
+	styles->entries = calloc(MAGMA_STYLES_INITIAL, sizeof(magma_style_t));
+	if(!styles->entries) {
+		magma_log_error("Failed to allocate style table\n");
+		goto err_entries;
+	}
+
+	styles->free_list = malloc(STYLES_MAX * sizeof(uint16_t));
+	if(!styles->free_list) {
+		magma_log_error("Failed to allocate style free list\n");
+		goto err_free_list;
+	}
+
+	styles->capacity = MAGMA_STYLES_INITIAL;
+	styles->count = 1;
+	if(styles_rehash(styles, MAGMA_STYLES_INITIAL * 2, NULL) < 0) {
+		goto err_hash;
+	}
+
+	return 0;
+
+err_hash:
+	free(styles->free_list);
+err_free_list:
+	free(styles->entries);
+err_entries:
+	return -1;
+}
+
+void magma_styles_deinit(magma_styles_t *styles) {
+	free(styles->hash);
+	free(styles->free_list);
+	free(styles->entries);
+}
+
+uint16_t magma_styles_intern(magma_vt_t *vt, const magma_style_t *style) {
+	static const magma_style_t none;
+	magma_styles_t *styles = &vt->styles;
+	uint32_t slot, index;
+
+	if(style_equal(style, &none)) {
+		return 0;
+	}
+
+	slot = styles_find(styles, style);
+	if(styles->hash[slot]) {
+		return styles->hash[slot];
+	}
+
+	if(styles->n_free == 0 && styles->count == styles->capacity &&
+			styles_grow(styles) < 0 && styles_collect(vt) < 0) {
+		return 0;
+	}
+
+	if(styles->n_free) {
+		index = styles->free_list[--styles->n_free];
+	} else if(styles->count < styles->capacity) {
+		index = styles->count++;
+	} else {
+		magma_log_warn("Style table is full\n");
+		return 0;
+	}
+
+	styles->entries[index] = *style;
+	/*growing or collecting rebuilt the hash*/
+	slot = styles_find(styles, style);
+	styles->hash[slot] = index;
+
+	return index;
+}
@@ -0,0 +1,294 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* builds for x86 cpus older than SSSE3, which is the default,
+ * still get the vector path and pick it at runtime
+ */
+#if defined(__SSSE3__)
+#define UTF8_SIMD
+#define UTF8_TARGET
+#define utf8_simd_supported() true
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UTF8_SIMD
+#define UTF8_TARGET __attribute__((target("ssse3")))
+#define utf8_simd_supported() __builtin_cpu_supports("ssse3")
+#endif
+
+#if defined(UTF8_SIMD)
+#include <immintrin.h>
+#endif
+
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+/* UTF8 -> UTF32 transcoder used by the parser.
+ *
+ * The checked decoder follows the WHATWG "UTF-8 decoder" algorithm
+ * so every maximal invalid subsequence becomes exactly one U+FFFD,
+ * and it keeps its state in magma_utf8_t so a character split
+ * across two reads is finished by the next call.
+ *
+ * Long runs are first validated 16 bytes at a time with the
+ * lookup algorithm from Keiser & Lemire "Validating UTF-8 In Less
+ * Than One Instruction Per Byte" and when valid are decoded
+ * without any per byte checks.
+ */
+
+#define UTF8_REPLACEMENT 0xfffd
+
+/*don't bother with the vector path for short runs*/
+#define UTF8_SIMD_MIN 64
+
+static inline void utf8_reset(magma_utf8_t *utf8) {
+	utf8->need = 0;
+	utf8->seen = 0;
+	utf8->lower = 0x80;
+	utf8->upper = 0xbf;
+}
+
+void magma_utf8_init(magma_utf8_t *utf8) {
+	utf8->codepoint = 0;
+	utf8_reset(utf8);
+}
+
+bool magma_utf8_flush(magma_utf8_t *utf8) {
+	if(utf8->need == 0) {
+		return false;
+	}
+
+	utf8_reset(utf8);
+	return true;
+}
+
+/**
+ *	@brief decode one byte
+ *
+ *	@retval 1 byte consumed
+ *	@retval 0 byte broke the current sequence and has to be fed again
+ */
+static inline int utf8_decode_byte(magma_utf8_t *utf8, uint8_t byte, utf32_t *out, size_t *n) {
+	if(utf8->need == 0) {
+		if(byte < 0x80) {
+			out[(*n)++] = byte;
+		} else if(byte >= 0xc2 && byte <= 0xdf) {
+			utf8->need = 1;
+			utf8->codepoint = byte & 0x1f;
+		} else if(byte >= 0xe0 && byte <= 0xef) {
+			if(byte == 0xe0) utf8->lower = 0xa0;
+			if(byte == 0xed) utf8->upper = 0x9f;
+			utf8->need = 2;
+			utf8->codepoint = byte & 0xf;
+		} else if(byte >= 0xf0 && byte <= 0xf4) {
+			if(byte == 0xf0) utf8->lower = 0x90;
+			if(byte == 0xf4) utf8->upper = 0x8f;
+			utf8->need = 3;
+			utf8->codepoint = byte & 0x7;
+		} else {
+			out[(*n)++] = UTF8_REPLACEMENT;
+		}
+		return 1;
+	}
+
+	if(byte < utf8->lower || byte > utf8->upper) {
+		utf8_reset(utf8);
+		out[(*n)++] = UTF8_REPLACEMENT;
+		return 0;
+	}
+
+	utf8->lower = 0x80;
+	utf8->upper = 0xbf;
+	utf8->codepoint = (utf8->codepoint << 6) | (byte & 0x3f);
+	if(++utf8->seen == utf8->need) {
+		out[(*n)++] = utf8->codepoint;
+		utf8_reset(utf8);
+	}
+
+	return 1;
+}
+
+#if defined(UTF8_SIMD)
+
+/*input must be complete and valid UTF8*/
+static size_t utf8_decode_unchecked(const uint8_t *buf, size_t len, utf32_t *out) {
+	size_t i = 0, n = 0;
+	uint8_t byte;
+
+	while(i < len) {
+		byte = buf[i];
+		if(byte < 0x80) {
+			out[n++] = byte;
+			i += 1;
+		} else if(byte < 0xe0) {
+			out[n++] = ((byte & 0x1f) << 6) | (buf[i+1] & 0x3f);
+			i += 2;
+		} else if(byte < 0xf0) {
+			out[n++] = ((byte & 0x0f) << 12) | ((buf[i+1] & 0x3f) << 6) | (buf[i+2] & 0x3f);
+			i += 3;
+		} else {
+			out[n++] = ((byte & 0x07) << 18) | ((buf[i+1] & 0x3f) << 12) |
+				((buf[i+2] & 0x3f) << 6) | (buf[i+3] & 0x3f);
+			i += 4;
+		}
+	}
+
+	return n;
+}
+
+/* shorten len so buf doesn't end part way through a
+ * character, the cut off bytes go through the checked path
+ */
+static size_t utf8_char_boundary(const uint8_t *buf, size_t len) {
+	for(size_t back = 1; back <= 3 && back <= len; back++) {
+		uint8_t byte = buf[len - back];
+		if((byte & 0xc0) == 0x80) {
+			continue;
+		}
+		if((byte >= 0xc0 && back < 2) || (byte >= 0xe0 && back < 3) || (byte >= 0xf0 && back < 4)) {
+			return len - back;
+		}
+		break;
+	}
+
+	return len;
+}
+
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t byte_1_high_tbl[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+static const uint8_t byte_1_low_tbl[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+static const uint8_t byte_2_high_tbl[16] = {
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+UTF8_TARGET static inline __m128i utf8_lookup(const uint8_t *table, __m128i index) {
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)table), index);
+}
+
+/*returns non zero lanes for every error in input given the block before it*/
+UTF8_TARGET static inline __m128i utf8_check_block(__m128i input, __m128i prev_input) {
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+	__m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+
+	__m128i byte_1_high = utf8_lookup(byte_1_high_tbl,
+			_mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+	__m128i byte_1_low = utf8_lookup(byte_1_low_tbl, _mm_and_si128(prev1, nibble));
+	__m128i byte_2_high = utf8_lookup(byte_2_high_tbl,
+			_mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+	__m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+	/*third and fourth bytes of 3/4 byte sequences must be continuations*/
+	__m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+	__m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+	__m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+
+	return _mm_xor_si128(must23, special);
+}
+
+UTF8_TARGET static bool utf8_validate(const uint8_t *buf, size_t len) {
+	__m128i prev = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+	__m128i input;
+	uint8_t tail[16];
+	size_t i;
+
+	for(i = 0; i + 16 <= len; i += 16) {
+		input = _mm_loadu_si128((const __m128i *)&buf[i]);
+		error = _mm_or_si128(error, utf8_check_block(input, prev));
+		prev = input;
+	}
+
+	/* pad the last block with ASCII so a sequence running
+	 * off the end shows up as TOO_SHORT
+	 */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, &buf[i], len - i);
+	input = _mm_loadu_si128((const __m128i *)tail);
+	error = _mm_or_si128(error, utf8_check_block(input, prev));
+	error = _mm_or_si128(error, utf8_check_block(_mm_setzero_si128(), input));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+#endif
+
+size_t magma_utf8_decode(magma_utf8_t *utf8, const uint8_t *buf, size_t len,
+		utf32_t *out, size_t out_len, size_t *n_out) {
+	size_t i = 0, n = 0;
+
+#if defined(UTF8_SIMD)
+	size_t span;
+
+	/*the checked path needs to finish a pending character first*/
+	while(utf8->need && i < len && n + 2 <= out_len) {
+		i += utf8_decode_byte(utf8, buf[i], out, &n);
+	}
+
+	if(utf8->need == 0 && len - i >= UTF8_SIMD_MIN && utf8_simd_supported()) {
+		span = len - i;
+		if(span > out_len - n) {
+			span = out_len - n;
+		}
+		span = utf8_char_boundary(&buf[i], span);
+
+		if(utf8_validate(&buf[i], span)) {
+			n += utf8_decode_unchecked(&buf[i], span, &out[n]);
+			i += span;
+		}
+	}
+#endif
+
+	/* a byte can produce two code points, a U+FFFD for the
+	 * sequence it broke and then itself
+	 */
+	while(i < len && n + 2 <= out_len) {
+		i += utf8_decode_byte(utf8, buf[i], out, &n);
+	}
+
+	*n_out = n;
+	return i;
+}
@@ -0,0 +1,1127 @@
+#include <pty.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+
+#include <magma/logger/log.h>
+#include <magma/unicode.h>
+#include <magma/vt.h>
+#include <magma/private/vt.h>
+
+#include <sys/ioctl.h>
+
+int magma_get_pty(int *pmaster, int *pslave) {
+	/* 
+	 * Switched to openpty as posix_openpt
+	 * was causing permission denied errors 
+	 * on a friends system
+	 */
+	if(openpty(pmaster, pslave, NULL, NULL, NULL) < 0) {
+		magma_log_error("openpty: %m\n");
+		return -1;
+	}
+
+	/* the master is drained in large chunks so reads
+	 * must return as soon as the pty is empty
+	 */
+	if(fcntl(*pmaster, F_SETFL, fcntl(*pmaster, F_GETFL) | O_NONBLOCK) < 0) {
+		magma_log_error("fcntl:(O_NONBLOCK) %m\n");
+		close(*pmaster);
+		close(*pslave);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	@brief Get fork master and slave. Slave is invalidated after call
+ *
+ *	@param [in] master master fd
+ *	@param [in/out] slave a pointer filled with slave fd
+ */
+pid_t magma_fork_pty(const int master, int *slave) {
+	pid_t pid;
+	int i = 0;
+	/*	We use sh as its shell that doesn't use 
+	 *	any fancy ANSI escape codes or want terminal 
+	 *	features we do not have 
+	 */
+	const char *args[] = { "/bin/sh", NULL };
+	/*	We use xterm here as some programs
+	 *	disable some functionality such as 
+	 *	not printing ANSI escape codes
+	 */
+	const char *env[] = { "TERM=xterm", NULL };
+
+	pid = fork();
+	if(pid == 0) {
+		/*we are the child process*/
+		close(master);
+		setsid();
+		if(ioctl(*slave, TIOCSCTTY, NULL) == -1) {
+			magma_log_error("IOCTL:(TIOCSCTTY) %m\n");
+			return -1;
+		}
+
+		/*std(in,out,err)*/
+		for(i = 0; i < 3; i++) { 
+			dup2(*slave, i);
+		}
+		close(*slave);	
+
+		execve(args[0], (char**)args, (char**)env); 	
+		/* we should handle this better as the master
+		 * essentially continues thinking the slave 
+		 * is running 
+		 */
+		exit(1);
+	} 
+	/*we are the parent process or error*/
+	close(*slave);
+	*slave = -1;
+	
+	/*0 success or -1 error*/
+	return pid;
+}
+
+magma_vt_t *magma_vt_init(int rows, int cols) {
+	magma_vt_t *vt;
+
+	vt = calloc(1, sizeof(*vt));
+	if(!vt) {
+		magma_log_error("Failed to allocate vt structure\n");
+		goto err_vt_alloc;
+	}
+
+	vt->read_buf = malloc(MAGMA_VT_READ_SIZE);
+	if(!vt->read_buf) {
+		magma_log_error("Failed to allocate vt read buffer\n");
+		goto err_read_buf;
+	}
+
+	vt->grid = magma_vt_grid_alloc(rows, cols);
+	if(!vt->grid) {
+		goto err_grid;
+	}
+
+	if(magma_styles_init(&vt->styles) < 0) {
+		goto err_styles;
+	}
+
+	if(magma_clusters_init(&vt->clusters) < 0) {
+		goto err_clusters;
+	}
+
+	vt->scrollback = magma_scrollback_init(MAGMA_VT_SCROLLBACK_DEFAULT, cols,
+			&vt->styles, &vt->clusters);
+	if(!vt->scrollback) {
+		goto err_scrollback;
+	}
+
+	vt->tabs = malloc(cols * sizeof(bool));
+	if(!vt->tabs) {
+		magma_log_error("Failed to allocate tab stops\n");
+		goto err_tabs;
+	}
+	for(int x = 0; x < cols; x++) {
+		vt->tabs[x] = x % MAGMA_VT_TAB_WIDTH == 0;
+	}
+
+	magma_vt_parser_init();
+	magma_utf8_init(&vt->parser.utf8);
+
+	vt->master = -1;
+	vt->rows = rows;
+	vt->cols = cols;
+	vt->scroll_bottom = rows - 1;
+	vt->fg = MAGMA_COLOR_DEFAULT;
+	vt->bg = MAGMA_COLOR_DEFAULT;
+
+	return vt;
+
+err_tabs:
+	magma_scrollback_deinit(vt->scrollback);
+err_scrollback:
+	magma_clusters_deinit(&vt->clusters);
+err_clusters:
+	magma_styles_deinit(&vt->styles);
+err_styles:
+	magma_vt_grid_free(vt->grid);
+err_grid:
+	free(vt->read_buf);
+err_read_buf:
+	free(vt);
+err_vt_alloc:
+	return NULL;
+}
+
+void magma_vt_deinit(magma_vt_t *vt) {
+	magma_vt_reader_stop(vt);
+
+	magma_scrollback_deinit(vt->scrollback);
+	magma_clusters_deinit(&vt->clusters);
+	magma_styles_deinit(&vt->styles);
+	magma_vt_grid_free(vt->grid);
+	magma_vt_grid_free(vt->other);
+	free(vt->tabs);
+	free(vt->read_buf);
+	free(vt);
+}
+
+/*number of ':' separated sub parameters following params[i]*/
+static int vt_sgr_subparams(const magma_vt_parser_t *parser, int i) {
+	int n = 0;
+
+	while(i + n + 1 < parser->n_params && (parser->subparams & (1 << (i + n + 1)))) {
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ *	@brief parse the color of a 38, 48 or 58 
+ *
+ *	Accepts both 38;5;n / 38;2;r;g;b and the ITU form with ':'
+ *	where the RGB components may be preceded by a color space id
+ *
+ *	@param [in] parser the parser holding the sequence
+ *	@param [in] i index of the 38/48/58 parameter
+ *	@param [out] color set to the packed color when valid
+ *	@return number of parameters after i that were used
+ */
+static int vt_sgr_color(const magma_vt_parser_t *parser, int i, uint32_t *color) {
+	const uint16_t *p = &parser->params[i + 1];
+	int sub = vt_sgr_subparams(parser, i);
+	int avail = sub ? sub : parser->n_params - i - 1;
+	int used;
+
+	if(avail < 1) {
+		return 0;
+	}
+
+	if(p[0] == 5) {
+		used = 2;
+		if(avail >= 2 && p[1] < 256) {
+			*color = MAGMA_COLOR_INDEXED(p[1]);
+		}
+	} else if(p[0] == 2) {
+		/*38:2:cs:r:g:b, the color space is ignored*/
+		if(sub >= 5) {
+			p++;
+		}
+		used = sub ? sub : 4;
+		if(avail >= 4 && p[1] < 256 && p[2] < 256 && p[3] < 256) {
+			*color = MAGMA_COLOR_RGB(p[1], p[2], p[3]);
+		}
+	} else {
+		/*unknown color type, only skip what was grouped with ':'*/
+		return sub;
+	}
+
+	return used < avail ? used : avail;
+}
+
+static void vt_sgr(magma_vt_t *vt) {
+	const magma_vt_parser_t *parser = &vt->parser;
+	uint32_t underline_color = 0;
+	uint16_t param;
+	int sub;
+
+	/*CSI m is the same as CSI 0 m*/
+	for(int i = 0; i < parser->n_params || i == 0; i++) {
+		param = magma_vt_param(parser, i, 0);
+		sub = vt_sgr_subparams(parser, i);
+
+		switch(param) {
+			case 0:
+				vt->attributes = 0;
+				vt->fg = MAGMA_COLOR_DEFAULT;
+				vt->bg = MAGMA_COLOR_DEFAULT;
+				break;
+			case 1: vt->attributes |= MAGMA_ATTR_BOLD; break;
+			case 2: vt->attributes |= MAGMA_ATTR_DIM; break;
+			case 3: vt->attributes |= MAGMA_ATTR_ITALIC; break;
+			case 4:
+				/*4:n picks the underline style, 4:0 turns it off*/
+				param = sub ? parser->params[i + 1] : MAGMA_UNDERLINE_SINGLE;
+				if(param <= MAGMA_UNDERLINE_DASHED) {
+					vt->attributes &= ~MAGMA_ATTR_UNDERLINE;
+					vt->attributes |= param << MAGMA_ATTR_UNDERLINE_SHIFT;
+				}
+				break;
+			case 5:
+			case 6: vt->attributes |= MAGMA_ATTR_BLINK; break;
+			case 7: vt->attributes |= MAGMA_ATTR_INVERSE; break;
+			case 8: vt->attributes |= MAGMA_ATTR_INVISIBLE; break;
+			case 9: vt->attributes |= MAGMA_ATTR_STRIKE; break;
+			case 21:
+				vt->attributes &= ~MAGMA_ATTR_UNDERLINE;
+				vt->attributes |= MAGMA_UNDERLINE_DOUBLE << MAGMA_ATTR_UNDERLINE_SHIFT;
+				break;
+			case 22: vt->attributes &= ~(MAGMA_ATTR_BOLD | MAGMA_ATTR_DIM); break;
+			case 23: vt->attributes &= ~MAGMA_ATTR_ITALIC; break;
+			case 24: vt->attributes &= ~MAGMA_ATTR_UNDERLINE; break;
+			case 25: vt->attributes &= ~MAGMA_ATTR_BLINK; break;
+			case 27: vt->attributes &= ~MAGMA_ATTR_INVERSE; break;
+			case 28: vt->attributes &= ~MAGMA_ATTR_INVISIBLE; break;
+			case 29: vt->attributes &= ~MAGMA_ATTR_STRIKE; break;
+			case 38: sub = vt_sgr_color(parser, i, &vt->fg); break;
+			case 39: vt->fg = MAGMA_COLOR_DEFAULT; break;
+			case 48: sub = vt_sgr_color(parser, i, &vt->bg); break;
+			case 49: vt->bg = MAGMA_COLOR_DEFAULT; break;
+			case 53: vt->attributes |= MAGMA_ATTR_OVERLINE; break;
+			case 55: vt->attributes &= ~MAGMA_ATTR_OVERLINE; break;
+			/*underline color isn't drawn yet, parse it so the params are skipped*/
+			case 58: sub = vt_sgr_color(parser, i, &underline_color); break;
+			default:
+				if(param >= 30 && param <= 37) {
+					vt->fg = MAGMA_COLOR_INDEXED(param - 30);
+				} else if(param >= 40 && param <= 47) {
+					vt->bg = MAGMA_COLOR_INDEXED(param - 40);
+				} else if(param >= 90 && param <= 97) {
+					vt->fg = MAGMA_COLOR_INDEXED(param - 90 + 8);
+				} else if(param >= 100 && param <= 107) {
+					vt->bg = MAGMA_COLOR_INDEXED(param - 100 + 8);
+				} else {
+					magma_log_info("Unhandled SGR %d\n", param);
+				}
+				break;
+		}
+
+		i += sub;
+	}
+
+	vt->style = magma_styles_intern(vt, &(magma_style_t){
+		.attributes = vt->attributes,
+		.fg = vt->fg,
+		.bg = vt->bg,
+	});
+}
+
+static uint64_t vt_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void vt_reply(magma_vt_t *vt, const char *fmt, ...) {
+	char buf[64];
+	va_list args;
+	int len;
+
+	if(vt->master < 0) {
+		return;
+	}
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	if(write(vt->master, buf, len) < 0) {
+		magma_log_error("write: %m\n");
+	}
+}
+
+/*map a DEC private mode number to its magma_vt_t.modes bit, 0 if unsupported*/
+static uint32_t vt_private_mode(uint16_t mode) {
+	switch(mode) {
+		case 47:
+		case 1047:
+		case 1049: return MAGMA_VT_MODE_ALT;
+		case 2026: return MAGMA_VT_MODE_SYNC;
+		default: return 0;
+	}
+}
+
+/*DECSC, into the screen shown*/
+static void vt_save_cursor(magma_vt_t *vt) {
+	vt->grid->saved = (magma_vt_cursor_t){
+		.x = vt->buf_x,
+		.y = vt->buf_y,
+		.fg = vt->fg,
+		.bg = vt->bg,
+		.attributes = vt->attributes,
+		.style = vt->style,
+	};
+	vt->wrap_pending = false;
+}
+
+/*DECRC, the screen may have shrunk since*/
+static void vt_restore_cursor(magma_vt_t *vt) {
+	const magma_vt_cursor_t *saved = &vt->grid->saved;
+
+	vt->buf_x = saved->x < vt->cols ? saved->x : vt->cols - 1;
+	vt->buf_y = saved->y < vt->rows ? saved->y : vt->rows - 1;
+	vt->wrap_pending = false;
+	vt->fg = saved->fg;
+	vt->bg = saved->bg;
+	vt->attributes = saved->attributes;
+	vt->style = saved->style;
+}
+
+/* 47 only switches screens, 1047 also clears the alternate
+ * screen when leaving it and 1049 saves the cursor and clears
+ * the alternate screen when entering it
+ */
+static void vt_alt_screen(magma_vt_t *vt, uint16_t mode, bool set) {
+	if(set == !!(vt->modes & MAGMA_VT_MODE_ALT)) {
+		return;
+	}
+
+	if(set && mode == 1049) {
+		vt_save_cursor(vt);
+	}
+
+	if(set && !vt->other) {
+		vt->other = magma_vt_grid_alloc(vt->rows, vt->cols);
+		if(!vt->other) {
+			return;
+		}
+	} else if(set && mode == 1049) {
+		magma_vt_grid_clear(vt->other, vt->rows);
+	}
+
+	if(!set && mode == 1047) {
+		for(int y = 0; y < vt->rows; y++) {
+			magma_vt_grid_erase(vt, y, 0, vt->cols, (glyph_t){ 0 });
+		}
+	}
+
+	magma_vt_screen_swap(vt);
+
+	if(!set && mode == 1049) {
+		vt_restore_cursor(vt);
+	}
+}
+
+static void vt_set_private_mode(magma_vt_t *vt, uint16_t mode, bool set) {
+	uint32_t bit = vt_private_mode(mode);
+
+	if(!bit) {
+		magma_log_info("Unhandled private mode %d\n", mode);
+		return;
+	}
+
+	if(bit == MAGMA_VT_MODE_ALT) {
+		vt_alt_screen(vt, mode, set);
+		return;
+	}
+
+	/*the first held update starts the timeout, later ones don't extend it*/
+	if(bit == MAGMA_VT_MODE_SYNC && set && vt->sync_start == 0) {
+		vt->sync_start = vt_now_ns();
+	}
+
+	if(set) {
+		vt->modes |= bit;
+	} else {
+		vt->modes &= ~bit;
+	}
+}
+
+/*DECRQM, CSI ? Ps $ p is answered with CSI ? Ps ; Pm $ y*/
+static void vt_request_private_mode(magma_vt_t *vt, uint16_t mode) {
+	uint32_t bit = vt_private_mode(mode);
+	/*0 not recognized, 1 set, 2 reset*/
+	int state = bit ? (vt->modes & bit ? 1 : 2) : 0;
+
+	vt_reply(vt, "\x1b[?%d;%d$y", mode, state);
+}
+
+bool magma_vt_frame_held(magma_vt_t *vt) {
+	if(!(vt->modes & MAGMA_VT_MODE_SYNC)) {
+		vt->sync_start = 0;
+		return false;
+	}
+
+	if(vt_now_ns() - vt->sync_start < (uint64_t)MAGMA_VT_SYNC_TIMEOUT_MS * 1000000) {
+		return true;
+	}
+
+	magma_log_warn("Synchronized update timed out\n");
+	vt->modes &= ~MAGMA_VT_MODE_SYNC;
+	vt->sync_start = 0;
+	return false;
+}
+
+/*erased cells keep the current background (BCE)*/
+static inline glyph_t vt_blank(magma_vt_t *vt) {
+	if(vt->bg == MAGMA_COLOR_DEFAULT) {
+		return (glyph_t){ 0 };
+	}
+
+	return (glyph_t){ .style = magma_styles_intern(vt, &(magma_style_t){ .bg = vt->bg }) };
+}
+
+static void vt_scroll(magma_vt_t *vt, int count) {
+	magma_vt_grid_scroll(vt, vt->scroll_top, vt->scroll_bottom, count, vt_blank(vt));
+}
+
+/*IND, scrolls when the cursor is on the bottom margin*/
+static void vt_newline(magma_vt_t *magmavt) {
+	magmavt->wrap_pending = false;
+	if(magmavt->buf_y == magmavt->scroll_bottom) {
+		vt_scroll(magmavt, 1);
+	} else if(magmavt->buf_y < magmavt->rows - 1) {
+		magmavt->buf_y++;
+	}
+}
+
+/*RI, the reverse of vt_newline*/
+static void vt_reverse_newline(magma_vt_t *vt) {
+	vt->wrap_pending = false;
+	if(vt->buf_y == vt->scroll_top) {
+		vt_scroll(vt, -1);
+	} else if(vt->buf_y > 0) {
+		vt->buf_y--;
+	}
+}
+
+static void vt_move_to(magma_vt_t *vt, int x, int y) {
+	vt->buf_x = x < 0 ? 0 : (x >= vt->cols ? vt->cols - 1 : x);
+	vt->buf_y = y < 0 ? 0 : (y >= vt->rows ? vt->rows - 1 : y);
+	vt->wrap_pending = false;
+}
+
+/*autowrap, the row is continued on the next one*/
+static void vt_wrap(magma_vt_t *vt) {
+	magma_vt_row(vt, vt->buf_y)->flags |= MAGMA_ROW_WRAPPED;
+	vt->buf_x = 0;
+	vt_newline(vt);
+}
+
+/* relative vertical moves stop at the margins, unless
+ * the cursor started outside of them
+ */
+static void vt_move_vertical(magma_vt_t *vt, int count) {
+	int y = vt->buf_y + count;
+
+	if(vt->buf_y >= vt->scroll_top && y < vt->scroll_top) {
+		y = vt->scroll_top;
+	} else if(vt->buf_y <= vt->scroll_bottom && y > vt->scroll_bottom) {
+		y = vt->scroll_bottom;
+	}
+
+	vt_move_to(vt, vt->buf_x, y);
+}
+
+/*IL and DL, only act when the cursor is inside the margins*/
+static void vt_insert_lines(magma_vt_t *vt, int count) {
+	if(vt->buf_y < vt->scroll_top || vt->buf_y > vt->scroll_bottom) {
+		return;
+	}
+
+	magma_vt_grid_scroll(vt, vt->buf_y, vt->scroll_bottom, -count, vt_blank(vt));
+	vt->buf_x = 0;
+	vt->wrap_pending = false;
+}
+
+static void vt_delete_lines(magma_vt_t *vt, int count) {
+	if(vt->buf_y < vt->scroll_top || vt->buf_y > vt->scroll_bottom) {
+		return;
+	}
+
+	magma_vt_grid_scroll(vt, vt->buf_y, vt->scroll_bottom, count, vt_blank(vt));
+	vt->buf_x = 0;
+	vt->wrap_pending = false;
+}
+
+/*DECSTBM, an invalid region is ignored*/
+static void vt_set_margins(magma_vt_t *vt, int top, int bottom) {
+	if(bottom > vt->rows) {
+		bottom = vt->rows;
+	}
+
+	if(top >= bottom) {
+		return;
+	}
+
+	vt->scroll_top = top - 1;
+	vt->scroll_bottom = bottom - 1;
+	vt_move_to(vt, 0, 0);
+}
+
+/*a wide character with its tail at x is erased altogether*/
+static void vt_split_at(magma_vt_t *vt, int y, line_t line, int x) {
+	if(x > 0 && x < vt->cols && line[x].flags & MAGMA_GLYPH_WIDE_TAIL) {
+		line[x - 1] = (glyph_t){ .style = line[x - 1].style };
+		line[x] = (glyph_t){ .style = line[x].style };
+		magma_vt_damage(vt, y, x - 1, x + 1);
+	}
+}
+
+/* cells x0 to x1 of row y are about to be written or moved, a
+ * wide character the range only has half of is erased first.
+ * A row sharing the blank row has none, so line can be read only
+ */
+static void vt_split_wide(magma_vt_t *vt, int y, line_t line, int x0, int x1) {
+	vt_split_at(vt, y, line, x0);
+	vt_split_at(vt, y, line, x1);
+}
+
+/*ECH and the partial rows of ED and EL*/
+static void vt_erase(magma_vt_t *vt, int y, int x0, int x1, glyph_t blank) {
+	vt_split_wide(vt, y, magma_vt_line(vt, y), x0, x1);
+	magma_vt_grid_erase(vt, y, x0, x1, blank);
+}
+
+/*ICH, the cells from cols - n on are pushed off the end*/
+static void vt_insert_cells(magma_vt_t *vt, int n) {
+	n = n < vt->cols - vt->buf_x ? n : vt->cols - vt->buf_x;
+	vt_split_wide(vt, vt->buf_y, magma_vt_line(vt, vt->buf_y), vt->buf_x, vt->cols - n);
+	magma_vt_grid_insert(vt, vt->buf_y, vt->buf_x, n, vt_blank(vt));
+}
+
+/*DCH*/
+static void vt_delete_cells(magma_vt_t *vt, int n) {
+	n = n < vt->cols - vt->buf_x ? n : vt->cols - vt->buf_x;
+	vt_split_wide(vt, vt->buf_y, magma_vt_line(vt, vt->buf_y), vt->buf_x, vt->buf_x + n);
+	magma_vt_grid_delete(vt, vt->buf_y, vt->buf_x, n, vt_blank(vt));
+}
+
+/*ED, 0 cursor to end, 1 start to cursor, 2 everything*/
+static void vt_erase_display(magma_vt_t *vt, int mode) {
+	glyph_t blank = vt_blank(vt);
+	int y0 = 0, y1 = vt->rows;
+
+	if(mode == 0) {
+		vt_erase(vt, vt->buf_y, vt->buf_x, vt->cols, blank);
+		y0 = vt->buf_y + 1;
+	} else if(mode == 1) {
+		vt_erase(vt, vt->buf_y, 0, vt->buf_x + 1, blank);
+		y1 = vt->buf_y;
+	} else if(mode != 2) {
+		return;
+	}
+
+	for(int y = y0; y < y1; y++) {
+		magma_vt_grid_erase(vt, y, 0, vt->cols, blank);
+	}
+}
+
+/*EL, same modes as ED for the cursor row*/
+static void vt_erase_line(magma_vt_t *vt, int mode) {
+	int x0 = 0, x1 = vt->cols;
+
+	if(mode == 0) {
+		x0 = vt->buf_x;
+	} else if(mode == 1) {
+		x1 = vt->buf_x + 1;
+	} else if(mode != 2) {
+		return;
+	}
+
+	vt_erase(vt, vt->buf_y, x0, x1, vt_blank(vt));
+}
+
+/*cells a character or cluster takes up, a cluster is as wide as its base*/
+static int vt_width(const magma_vt_t *vt, utf32_t unicode) {
+	if(unicode & MAGMA_GLYPH_CLUSTER) {
+		unicode = vt->clusters.data[vt->clusters.entries[unicode & ~MAGMA_GLYPH_CLUSTER].offset];
+	}
+
+	return magma_wcwidth(unicode);
+}
+
+/*GB11, the cluster is Extended_Pictographic Extend* ZWJ*/
+static bool vt_pictographic_zwj(const utf32_t *cps, int len) {
+	int i = len - 2;
+
+	while(i >= 0 && magma_unicode_gcb(cps[i]) == MAGMA_GCB_EXTEND) {
+		i--;
+	}
+
+	return i >= 0 && magma_unicode_props(cps[i]) & MAGMA_UNICODE_PICTOGRAPHIC;
+}
+
+/* UAX #29 rules that keep a code point in the cluster printed
+ * before it, the ones about controls don't matter as those are
+ * never printed
+ */
+static bool vt_joins(const magma_vt_t *vt, enum magma_gcb gcb, bool pictographic) {
+	const utf32_t *cps;
+	int len;
+
+	/*GB9, GB9a*/
+	if(gcb == MAGMA_GCB_EXTEND || gcb == MAGMA_GCB_ZWJ || gcb == MAGMA_GCB_SPACING_MARK) {
+		return true;
+	}
+
+	switch((vt->last_props & MAGMA_UNICODE_GCB_MASK) >> MAGMA_UNICODE_GCB_SHIFT) {
+	/*GB9b*/
+	case MAGMA_GCB_PREPEND:
+		return true;
+	/*GB6 to GB8, hangul syllables*/
+	case MAGMA_GCB_L:
+		return gcb == MAGMA_GCB_L || gcb == MAGMA_GCB_V ||
+			gcb == MAGMA_GCB_LV || gcb == MAGMA_GCB_LVT;
+	case MAGMA_GCB_LV:
+	case MAGMA_GCB_V:
+		return gcb == MAGMA_GCB_V || gcb == MAGMA_GCB_T;
+	case MAGMA_GCB_LVT:
+	case MAGMA_GCB_T:
+		return gcb == MAGMA_GCB_T;
+	/*GB11, emoji ZWJ sequences*/
+	case MAGMA_GCB_ZWJ:
+		if(!pictographic) {
+			return false;
+		}
+		cps = magma_vt_cluster(vt, &(glyph_t){ .unicode = vt->last }, &len);
+		return vt_pictographic_zwj(cps, len);
+	/*GB12, GB13, flags are pairs*/
+	case MAGMA_GCB_REGIONAL_INDICATOR:
+		return gcb == MAGMA_GCB_REGIONAL_INDICATOR && !(vt->last & MAGMA_GLYPH_CLUSTER);
+	default:
+		return false;
+	}
+}
+
+/* add unicode to the cell left of the cursor, the break rules
+ * have already said it continues the cluster last printed,
+ * returns whether it was taken
+ */
+static bool vt_join(magma_vt_t *vt, utf32_t unicode, uint8_t props) {
+	/*the cursor stays on the last column until autowrap*/
+	int x = vt->wrap_pending ? vt->buf_x : vt->buf_x - 1, y = vt->buf_y;
+	utf32_t cluster;
+	line_t line;
+
+	if(x < 0) {
+		return false;
+	}
+
+	line = magma_vt_line(vt, y);
+	if(x > 0 && line[x].flags & MAGMA_GLYPH_WIDE_TAIL) {
+		x--;
+	}
+
+	/*the cursor moved or the cell was written over since*/
+	if(!vt->last || line[x].unicode != vt->last) {
+		return false;
+	}
+
+	/*a code point that didn't fit is dropped but still part of the cluster*/
+	cluster = magma_clusters_append(vt, vt->last, unicode);
+	if(cluster != vt->last) {
+		line = magma_vt_line_write(vt, y);
+		line[x].unicode = cluster;
+		magma_vt_damage(vt, y, x, x + (line[x].flags & MAGMA_GLYPH_WIDE ? 2 : 1));
+		vt->last = cluster;
+	}
+	vt->last_props = props;
+
+	return true;
+}
+
+void magma_vt_print(magma_vt_t *magmavt, utf32_t unicode) {
+	uint8_t props = 0;
+	line_t line;
+	int width;
+
+	/*REP hands back whole clusters*/
+	if(unicode & MAGMA_GLYPH_CLUSTER) {
+		width = vt_width(magmavt, unicode);
+	} else {
+		props = magma_unicode_props(unicode);
+		width = props & MAGMA_UNICODE_WIDTH_MASK;
+
+		if(vt_joins(magmavt, (props & MAGMA_UNICODE_GCB_MASK) >> MAGMA_UNICODE_GCB_SHIFT,
+				props & MAGMA_UNICODE_PICTOGRAPHIC) && vt_join(magmavt, unicode, props)) {
+			return;
+		}
+	}
+
+	/*zero width characters have no cell of their own*/
+	if(width == 0) {
+		return;
+	}
+
+	if(width == 2 && magmavt->cols < 2) {
+		width = 1;
+	}
+
+	/*a wide character doesn't fit in the last column, it goes on the next row*/
+	if(magmavt->wrap_pending || (width == 2 && magmavt->buf_x == magmavt->cols - 1)) {
+		vt_wrap(magmavt);
+	}
+
+	/* we store the character as UTF32
+	 * as it's what freetype expects
+	 * and it saves us having to process
+	 * the UTF8 character sequence into a
+	 * UTF32 character every draw sequence
+	 */
+	line = magma_vt_line_write(magmavt, magmavt->buf_y);
+	vt_split_wide(magmavt, magmavt->buf_y, line, magmavt->buf_x, magmavt->buf_x + width);
+	line[magmavt->buf_x] = (glyph_t){
+		.unicode = unicode,
+		.style = magmavt->style,
+		.flags = width == 2 ? MAGMA_GLYPH_WIDE : 0,
+	};
+	if(width == 2) {
+		line[magmavt->buf_x + 1] = (glyph_t){
+			.style = magmavt->style,
+			.flags = MAGMA_GLYPH_WIDE_TAIL,
+		};
+	}
+	magma_vt_damage(magmavt, magmavt->buf_y, magmavt->buf_x, magmavt->buf_x + width);
+	magma_vt_use(magmavt, magmavt->buf_y, magmavt->buf_x + width);
+	/*a repeated cluster already is the last character*/
+	if(!(unicode & MAGMA_GLYPH_CLUSTER)) {
+		magmavt->last = unicode;
+		magmavt->last_props = props;
+	}
+
+	if(magmavt->buf_x + width >= magmavt->cols) {
+		magmavt->buf_x = magmavt->cols - 1;
+		magmavt->wrap_pending = true;
+	} else {
+		magmavt->buf_x += width;
+	}
+}
+
+void magma_vt_print_ascii(magma_vt_t *magmavt, const uint8_t *buf, size_t len) {
+	glyph_t pen = {
+		.style = magmavt->style,
+	};
+	line_t line;
+	size_t n;
+
+	while(len) {
+		if(magmavt->wrap_pending) {
+			vt_wrap(magmavt);
+		}
+
+		n = magmavt->cols - magmavt->buf_x;
+		if(n > len) {
+			n = len;
+		}
+
+		line = magma_vt_line_write(magmavt, magmavt->buf_y);
+		vt_split_wide(magmavt, magmavt->buf_y, line, magmavt->buf_x, magmavt->buf_x + n);
+		line += magmavt->buf_x;
+		for(size_t i = 0; i < n; i++) {
+			pen.unicode = buf[i];
+			line[i] = pen;
+		}
+		magma_vt_damage(magmavt, magmavt->buf_y, magmavt->buf_x, magmavt->buf_x + n);
+		magma_vt_use(magmavt, magmavt->buf_y, magmavt->buf_x + n);
+		magmavt->last = buf[n - 1];
+		magmavt->last_props = magma_unicode_props(buf[n - 1]);
+
+		magmavt->buf_x += n;
+		if(magmavt->buf_x >= magmavt->cols) {
+			magmavt->buf_x = magmavt->cols - 1;
+			magmavt->wrap_pending = true;
+		}
+
+		buf += n;
+		len -= n;
+	}
+}
+
+/*REP, print the last character n more times*/
+static void vt_repeat(magma_vt_t *vt, int n) {
+	glyph_t cell = {
+		.unicode = vt->last,
+		.style = vt->style,
+	};
+	int k;
+
+	if(!vt->last) {
+		return;
+	}
+
+	/*wide characters need their tail cells, more than a screen full can't show*/
+	if(vt_width(vt, vt->last) != 1) {
+		for(n = n < vt->rows * vt->cols ? n : vt->rows * vt->cols; n > 0; n--) {
+			magma_vt_print(vt, vt->last);
+		}
+		return;
+	}
+
+	while(n > 0) {
+		if(vt->wrap_pending) {
+			vt_wrap(vt);
+		}
+
+		k = vt->cols - vt->buf_x;
+		if(k > n) {
+			k = n;
+		}
+
+		vt_split_wide(vt, vt->buf_y, magma_vt_line(vt, vt->buf_y), vt->buf_x, vt->buf_x + k);
+		magma_vt_grid_repeat(vt, vt->buf_y, vt->buf_x, k, cell);
+		n -= k;
+
+		vt->buf_x += k;
+		if(vt->buf_x >= vt->cols) {
+			vt->buf_x = vt->cols - 1;
+			vt->wrap_pending = true;
+		}
+	}
+}
+
+/*HT and CHT, n tab stops on or the last column when there are no more*/
+static void vt_tab(magma_vt_t *vt, int n) {
+	int x = vt->buf_x;
+
+	while(n > 0 && x < vt->cols - 1) {
+		if(vt->tabs[++x]) {
+			n--;
+		}
+	}
+	vt->buf_x = x;
+	vt->wrap_pending = false;
+}
+
+/*CBT, n tab stops back or the first column*/
+static void vt_back_tab(magma_vt_t *vt, int n) {
+	int x = vt->buf_x;
+
+	while(n > 0 && x > 0) {
+		if(vt->tabs[--x]) {
+			n--;
+		}
+	}
+	vt->buf_x = x;
+	vt->wrap_pending = false;
+}
+
+/*TBC, 0 clears the stop at the cursor and 3 all of them*/
+static void vt_clear_tabs(magma_vt_t *vt, int mode) {
+	if(mode == 0) {
+		vt->tabs[vt->buf_x] = false;
+	} else if(mode == 3) {
+		memset(vt->tabs, 0, vt->cols * sizeof(bool));
+	}
+}
+
+void magma_vt_execute(magma_vt_t *magmavt, uint8_t byte) {
+	switch(byte) {
+		case '\b':
+			if(magmavt->buf_x > 0) {
+				magmavt->buf_x--;
+			}
+			magmavt->wrap_pending = false;
+			break;
+		case '\t':
+			vt_tab(magmavt, 1);
+			break;
+		case '\n':
+		case '\v':
+		case '\f':
+			vt_newline(magmavt);
+			break;
+		case '\r':
+			magmavt->buf_x = 0;
+			magmavt->wrap_pending = false;
+			break;
+		default:
+			break;
+	}
+}
+
+void magma_vt_esc_dispatch(magma_vt_t *vt, uint8_t final) {
+	if(vt->parser.n_intermediates) {
+		magma_log_info("Unhandled ESC %c %c\n", vt->parser.intermediates[0], final);
+		return;
+	}
+
+	switch(final) {
+		case 'D':
+			vt_newline(vt);
+			break;
+		case 'E':
+			vt->buf_x = 0;
+			vt_newline(vt);
+			break;
+		case 'M':
+			vt_reverse_newline(vt);
+			break;
+		case 'H':
+			vt->tabs[vt->buf_x] = true;
+			break;
+		case '7':
+			vt_save_cursor(vt);
+			break;
+		case '8':
+			vt_restore_cursor(vt);
+			break;
+		default:
+			magma_log_info("Unhandled ESC %c\n", final);
+			break;
+	}
+}
+
+/*CSI sequences without a private marker or intermediates*/
+static bool vt_csi_dispatch_plain(magma_vt_t *vt, uint8_t final) {
+	const magma_vt_parser_t *parser = &vt->parser;
+	int n = magma_vt_param(parser, 0, 1);
+
+	switch(final) {
+		case 'm':
+			vt_sgr(vt);
+			break;
+		case 'A':
+			vt_move_vertical(vt, -n);
+			break;
+		case 'B':
+		case 'e':
+			vt_move_vertical(vt, n);
+			break;
+		case 'C':
+		case 'a':
+			vt_move_to(vt, vt->buf_x + n, vt->buf_y);
+			break;
+		case 'D':
+			vt_move_to(vt, vt->buf_x - n, vt->buf_y);
+			break;
+		case 'E':
+			vt->buf_x = 0;
+			vt_move_vertical(vt, n);
+			break;
+		case 'F':
+			vt->buf_x = 0;
+			vt_move_vertical(vt, -n);
+			break;
+		case 'G':
+		case '`':
+			vt_move_to(vt, n - 1, vt->buf_y);
+			break;
+		case 'H':
+		case 'f':
+			vt_move_to(vt, magma_vt_param(parser, 1, 1) - 1, n - 1);
+			break;
+		case 'd':
+			vt_move_to(vt, vt->buf_x, n - 1);
+			break;
+		case 'J':
+			vt_erase_display(vt, magma_vt_param(parser, 0, 0));
+			break;
+		case 'K':
+			vt_erase_line(vt, magma_vt_param(parser, 0, 0));
+			break;
+		case 'X':
+			vt_erase(vt, vt->buf_y, vt->buf_x, vt->buf_x + n, vt_blank(vt));
+			break;
+		case '@':
+			vt_insert_cells(vt, n);
+			break;
+		case 'P':
+			vt_delete_cells(vt, n);
+			break;
+		case 'b':
+			vt_repeat(vt, n);
+			break;
+		case 'I':
+			vt_tab(vt, n);
+			break;
+		case 'Z':
+			vt_back_tab(vt, n);
+			break;
+		case 'g':
+			vt_clear_tabs(vt, magma_vt_param(parser, 0, 0));
+			break;
+		case 'L':
+			vt_insert_lines(vt, n);
+			break;
+		case 'M':
+			vt_delete_lines(vt, n);
+			break;
+		case 'S':
+			vt_scroll(vt, n);
+			break;
+		case 'T':
+			vt_scroll(vt, -n);
+			break;
+		case 'r':
+			vt_set_margins(vt, magma_vt_param(parser, 0, 1), magma_vt_param(parser, 1, vt->rows));
+			break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+void magma_vt_csi_dispatch(magma_vt_t *vt, uint8_t final) {
+	const magma_vt_parser_t *parser = &vt->parser;
+
+	if(parser->n_intermediates == 0 && vt_csi_dispatch_plain(vt, final)) {
+		return;
+	}
+
+	if(parser->n_intermediates >= 1 && parser->intermediates[0] == '?') {
+		if(parser->n_intermediates == 1 && (final == 'h' || final == 'l')) {
+			for(int i = 0; i < parser->n_params; i++) {
+				vt_set_private_mode(vt, parser->params[i], final == 'h');
+			}
+			return;
+		}
+
+		if(parser->n_intermediates == 2 && parser->intermediates[1] == '$' && final == 'p') {
+			vt_request_private_mode(vt, magma_vt_param(parser, 0, 0));
+			return;
+		}
+	}
+
+	magma_log_info("Unhandled CSI %c\n", final);
+}
+
+void magma_vt_osc_dispatch(magma_vt_t *vt) {
+	magma_log_info("Unhandled OSC %s\n", vt->parser.osc);
+}
+
+void magma_vt_parse(magma_vt_t *magmavt, const uint8_t *buf, size_t len) {
+	magma_vt_parser_feed(magmavt, buf, len);
+}
+
+ssize_t vt_read_input(magma_vt_t *magmavt) {
+	size_t total = 0;
+	ssize_t ret;
+
+	if(magmavt->reader) {
+		return magma_vt_reader_consume(magmavt);
+	}
+
+	while(total < MAGMA_VT_READ_MAX) {
+		ret = read(magmavt->master, magmavt->read_buf, MAGMA_VT_READ_SIZE);
+		if(ret < 0) {
+			if(errno == EINTR) {
+				continue;
+			} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			/* linux returns EIO once the slave
+			 * side has been closed by the child
+			 */
+			if(errno != EIO) {
+				magma_log_error("read: %m\n");
+			}
+			return -1;
+		} else if(ret == 0) {
+			return -1;
+		}
+
+		total += ret;
+		magma_vt_parse(magmavt, magmavt->read_buf, ret);
+
+		/*a short read means the pty is empty*/
+		if(ret < MAGMA_VT_READ_SIZE) {
+			break;
+		}
+	}
+
+	return total;
+}
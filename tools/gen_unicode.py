@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+# Generates the unicode property tables behind magma_wcwidth() and
+# magma_unicode_props(), see includes/magma/unicode.h
+#
+# usage: gen_unicode.py OUTPUT [UCD_DIR]
+#
+# With UCD_DIR the properties are read from EastAsianWidth.txt,
+# GraphemeBreakProperty.txt and emoji-data.txt in it, otherwise
+# they are derived from the unicodedata module of this python.
+#
+# Every code point gets one byte, bits 0-1 are the width, 2-5 the
+# grapheme break class and bit 6 is Extended_Pictographic. The
+# bytes are split into 64 entry leaves and 64 leaf indices per
+# 4096 code points, both deduplicated, so a lookup is three loads.
+
+import os
+import sys
+import unicodedata
+
+MAX = 0x110000
+LEAF = 64
+MID = 64
+
+# has to match enum magma_gcb
+GCB = [ 'Other', 'CR', 'LF', 'Control', 'Extend', 'ZWJ', 'Regional_Indicator',
+	'Prepend', 'SpacingMark', 'L', 'V', 'T', 'LV', 'LVT' ]
+
+# unassigned code points in these default to wide
+WIDE_DEFAULT = [ (0x3400, 0x4dbf), (0x4e00, 0x9fff), (0xf900, 0xfaff),
+	(0x20000, 0x2fffd), (0x30000, 0x3fffd) ]
+
+# Extended_Pictographic isn't in unicodedata, these are the ranges
+# of emoji-data.txt merged where only unassigned code points lie between
+PICTOGRAPHIC = [
+	(0x00a9, 0x00a9), (0x00ae, 0x00ae), (0x203c, 0x203c), (0x2049, 0x2049),
+	(0x2122, 0x2122), (0x2139, 0x2139), (0x2194, 0x2199), (0x21a9, 0x21aa),
+	(0x231a, 0x231b), (0x2328, 0x2328), (0x2388, 0x2388), (0x23cf, 0x23cf),
+	(0x23e9, 0x23f3), (0x23f8, 0x23fa), (0x24c2, 0x24c2), (0x25aa, 0x25ab),
+	(0x25b6, 0x25b6), (0x25c0, 0x25c0), (0x25fb, 0x25fe), (0x2600, 0x2605),
+	(0x2607, 0x2612), (0x2614, 0x2685), (0x2690, 0x2705), (0x2708, 0x2712),
+	(0x2714, 0x2714), (0x2716, 0x2716), (0x271d, 0x271d), (0x2721, 0x2721),
+	(0x2728, 0x2728), (0x2733, 0x2734), (0x2744, 0x2744), (0x2747, 0x2747),
+	(0x274c, 0x274c), (0x274e, 0x274e), (0x2753, 0x2755), (0x2757, 0x2757),
+	(0x2763, 0x2767), (0x2795, 0x2797), (0x27a1, 0x27a1), (0x27b0, 0x27b0),
+	(0x27bf, 0x27bf), (0x2934, 0x2935), (0x2b05, 0x2b07), (0x2b1b, 0x2b1c),
+	(0x2b50, 0x2b50), (0x2b55, 0x2b55), (0x3030, 0x3030), (0x303d, 0x303d),
+	(0x3297, 0x3297), (0x3299, 0x3299), (0x1f000, 0x1f0ff), (0x1f10d, 0x1f10f),
+	(0x1f12f, 0x1f12f), (0x1f16c, 0x1f171), (0x1f17e, 0x1f17f), (0x1f18e, 0x1f18e),
+	(0x1f191, 0x1f19a), (0x1f1ad, 0x1f1e5), (0x1f201, 0x1f20f), (0x1f21a, 0x1f21a),
+	(0x1f22f, 0x1f22f), (0x1f232, 0x1f23a), (0x1f23c, 0x1f23f), (0x1f249, 0x1f3fa),
+	(0x1f400, 0x1f53d), (0x1f546, 0x1f64f), (0x1f680, 0x1f6ff), (0x1f774, 0x1f77f),
+	(0x1f7d5, 0x1f7ff), (0x1f80c, 0x1f80f), (0x1f848, 0x1f84f), (0x1f85a, 0x1f85f),
+	(0x1f888, 0x1f88f), (0x1f8ae, 0x1f8ff), (0x1f90c, 0x1f93a), (0x1f93c, 0x1f945),
+	(0x1f947, 0x1faff), (0x1fc00, 0x1fffd),
+]
+
+PREPEND = [ (0x0600, 0x0605), (0x06dd, 0x06dd), (0x070f, 0x070f), (0x0890, 0x0891),
+	(0x08e2, 0x08e2), (0x0d4e, 0x0d4e), (0x110bd, 0x110bd), (0x110cd, 0x110cd),
+	(0x111c2, 0x111c3), (0x1193f, 0x1193f), (0x11941, 0x11941), (0x11a3a, 0x11a3a),
+	(0x11a84, 0x11a89), (0x11d46, 0x11d46) ]
+
+def ranges(table):
+	for first, last in table:
+		yield from range(first, last + 1)
+
+def read_ucd(path):
+	"""code point -> value of a UCD "range ; value # comment" file"""
+	values = {}
+	with open(path, encoding='utf-8') as f:
+		for line in f:
+			line = line.split('#', 1)[0].strip()
+			if not line:
+				continue
+			cps, value = [ field.strip() for field in line.split(';')[:2] ]
+			first, _, last = cps.partition('..')
+			for cp in range(int(first, 16), int(last or first, 16) + 1):
+				values[cp] = value
+	return values
+
+def derive_gcb(cp, cat):
+	if cp == 0x0d:
+		return 'CR'
+	if cp == 0x0a:
+		return 'LF'
+	if cp == 0x200d:
+		return 'ZWJ'
+	if 0x1f1e6 <= cp <= 0x1f1ff:
+		return 'Regional_Indicator'
+	if 0x1100 <= cp <= 0x115f or 0xa960 <= cp <= 0xa97c:
+		return 'L'
+	if 0x1160 <= cp <= 0x11a7 or 0xd7b0 <= cp <= 0xd7c6:
+		return 'V'
+	if 0x11a8 <= cp <= 0x11ff or 0xd7cb <= cp <= 0xd7fb:
+		return 'T'
+	if 0xac00 <= cp <= 0xd7a3:
+		return 'LV' if (cp - 0xac00) % 28 == 0 else 'LVT'
+	if cat in ('Mn', 'Me') or cp == 0x200c or 0x1f3fb <= cp <= 0x1f3ff or 0xe0020 <= cp <= 0xe007f:
+		return 'Extend'
+	if cat == 'Mc' or cp in (0x0e33, 0x0eb3):
+		return 'SpacingMark'
+	if cat in ('Cc', 'Zl', 'Zp', 'Cf') or (cat == 'Cn' and 0xe0000 <= cp <= 0xe0fff):
+		return 'Control'
+	return 'Other'
+
+def build(ucd):
+	eaw = gcb = pict = None
+	if ucd:
+		eaw = read_ucd(os.path.join(ucd, 'EastAsianWidth.txt'))
+		gcb = read_ucd(os.path.join(ucd, 'GraphemeBreakProperty.txt'))
+		pict = set(cp for cp, value in read_ucd(os.path.join(ucd, 'emoji-data.txt')).items()
+			if value == 'Extended_Pictographic')
+		prepend = set(cp for cp, value in gcb.items() if value == 'Prepend')
+	else:
+		pict = set(ranges(PICTOGRAPHIC))
+		prepend = set(ranges(PREPEND))
+	wide_default = set(ranges(WIDE_DEFAULT))
+
+	props = bytearray(MAX)
+	for cp in range(MAX):
+		cat = unicodedata.category(chr(cp))
+
+		if gcb is not None:
+			brk = gcb.get(cp, 'Other')
+		elif cp in prepend:
+			brk = 'Prepend'
+		else:
+			brk = derive_gcb(cp, cat)
+
+		if eaw is not None:
+			ea = eaw.get(cp, 'W' if cp in wide_default else 'N')
+		else:
+			ea = unicodedata.east_asian_width(chr(cp))
+			if cat == 'Cn' and cp in wide_default:
+				ea = 'W'
+
+		# soft hyphen and the prepended concatenation marks are visible
+		if cat in ('Mn', 'Me', 'Cc', 'Zl', 'Zp') or brk in ('V', 'T') or \
+				(cat == 'Cf' and cp != 0x00ad and brk != 'Prepend'):
+			width = 0
+		elif ea in ('W', 'F'):
+			width = 2
+		else:
+			width = 1
+
+		props[cp] = width | GCB.index(brk) << 2 | (cp in pict) << 6
+	return props
+
+def split(data, size):
+	"""deduplicate blocks of size, returns the blocks and an index per block"""
+	blocks, index, seen = [], [], {}
+	for i in range(0, len(data), size):
+		block = tuple(data[i:i + size])
+		if block not in seen:
+			seen[block] = len(blocks)
+			blocks.append(block)
+		index.append(seen[block])
+	return blocks, index
+
+def emit(f, ctype, name, values, per_line):
+	f.write('const %s %s[%d] = {\n' % (ctype, name, len(values)))
+	for i in range(0, len(values), per_line):
+		f.write('\t' + ' '.join('%d,' % v for v in values[i:i + per_line]) + '\n')
+	f.write('};\n\n')
+
+def main():
+	if len(sys.argv) < 2:
+		sys.exit('usage: %s OUTPUT [UCD_DIR]' % sys.argv[0])
+	ucd = sys.argv[2] if len(sys.argv) > 2 and sys.argv[2] else None
+
+	props = build(ucd)
+	leaves, leaf_index = split(props, LEAF)
+	mids, mid_index = split(leaf_index, MID)
+	assert len(mids) < 256 and len(leaves) < 65536
+
+	with open(sys.argv[1], 'w') as f:
+		f.write('/* generated by tools/gen_unicode.py from %s, do not edit */\n\n'
+			% ('the UCD in ' + ucd if ucd else 'python unicodedata ' + unicodedata.unidata_version))
+		f.write('#include <stdint.h>\n\n#include <magma/unicode.h>\n\n')
+		emit(f, 'uint8_t', 'magma_unicode_stage1', mid_index, 16)
+		emit(f, 'uint16_t', 'magma_unicode_stage2', [ i for mid in mids for i in mid ], 16)
+		emit(f, 'uint8_t', 'magma_unicode_stage3', [ p for leaf in leaves for p in leaf ], 16)
+
+if __name__ == '__main__':
+	main()